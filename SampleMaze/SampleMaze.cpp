@@ -43,22 +43,28 @@ const char level[Y][X+1] = {
 #define MAX_FRAMES 100
 #define MAX_STEPS MAX_FRAMES
 
+/// Problem traits (see search.cpp). Every move takes one frame, can be undone by the opposite move, and a state has at most 4 children.
+#define UNIT_COST
+#define REVERSIBLE_MOVES
+#define MAX_BRANCHING 4
+
+/// The fields of the state and their widths in bits (coordinates are below 16).
+#define STATE_FIELDS(FIELD) \
+	FIELD(x, 4)             \
+	FIELD(y, 4)
+
 /// The state as it will be saved on disk. If frame grouping is used, this structure must also contain the subframe field, aligned to byte boundary.
 /// Warning: binary comparison is used for this structure, mind alignment gaps and uninitialized data.
 struct CompressedState
 {
-	uint16_t x;
-	uint16_t y;
+	uint8_t data[PACKED_BYTES(STATE_FIELDS)];
 
 	/// Used for debugging...
-	const char* toString() const
-	{
-		return format("%2d,%2d", x, y);
-	}
+	const char* toString() const;
 };
 
 /// Number of bits of data in CompressedState, *excluding* subframe. This is used for efficient comparison operators.
-#define COMPRESSED_BITS 32
+#define COMPRESSED_BITS PACKED_BITS(STATE_FIELDS)
 
 /// The in-memory structure representing the problem state. Needs to contain at least the functions isFinish, compress, decompress and toString.
 struct State
@@ -83,20 +89,33 @@ struct State
 		return level[y][x] == 'F';
 	}
 
-	/// Compress this instance to CompressedState.
-	void compress(CompressedState* s) const
+	/// Returns a lower bound of the number of frames needed to reach a finish state (the Manhattan distance to the closest one).
+	/// Only used if HAVE_LOWER_BOUND is defined; must never overestimate.
+	INLINE int lowerBound() const;
+
+	/// Transforms this state into the canonical form of its symmetry class (only used if USE_TRANSFORM_INVARIANT_SORTING is defined).
+	/// All symmetric versions of a state must produce the same canonical state, and isFinish must give the same result for them.
+	/// This maze has no symmetries.
+	void canonicalize()
+	{
+	}
+
+	/// Projects this state onto its abstraction, for building the pattern database (only used if HAVE_PATTERN_DATABASE is defined).
+	/// The abstract state space is searched with expandParents, so it must accept abstract states.
+	/// The maze is small enough to not need abstracting, which makes the pattern database hold exact distances.
+	void abstract()
 	{
-		s->x = x;
-		s->y = y;
 	}
 
-	/// Restore (overwrite) this instance from CompressedState.
-	void decompress(const CompressedState* s)
+	/// Returns the index of this abstract state in the pattern database (0 <= index < PATTERN_DATABASE_SIZE).
+	INLINE uint32_t patternIndex() const
 	{
-	    x = s->x;
-	    y = s->y;
+		return y*X + x;
 	}
 
+	/// Compress this instance to CompressedState, and restore (overwrite) it from CompressedState.
+	PACKED_CODEC(STATE_FIELDS)
+
 	/// Return a textual visualisation of the state.
 	const char* toString() const
 	{
@@ -113,6 +132,20 @@ struct State
 	}
 };
 
+const char* CompressedState::toString() const
+{
+	State s;
+	s.decompress(this);
+	return format("%2d,%2d", s.x, s.y);
+}
+
+/// Lets the search discard children which can't reach a finish state within the frame limit.
+#define HAVE_LOWER_BOUND
+
+/// Enables the "build-pdb" run mode, and lets the search use the pattern database for pruning.
+#define HAVE_PATTERN_DATABASE
+#define PATTERN_DATABASE_SIZE (X*Y)
+
 /// A State equality operator is required.
 INLINE bool operator==(const State& a, const State& b)
 {
@@ -128,6 +161,29 @@ INLINE bool canStatesBeParentAndChild(const CompressedState* parent, const Compr
 	return true;
 }
 
+/// Lets merges discard states which are made redundant by another state (see HAVE_DOMINANCE in search.cpp).
+/// The maze has no resources, so a state is only dominated by the same position reached no later, which the merges already
+/// treat as a duplicate; this shows the interface on a key which groups the states of each row.
+#define HAVE_DOMINANCE
+
+/// Returns true if a and b are in the same row. y is packed after x, so the states of a row are adjacent in sort order.
+INLINE bool sameDominanceKey(const CompressedState* a, const CompressedState* b)
+{
+	State sa, sb;
+	sa.decompress(a);
+	sb.decompress(b);
+	return sa.y == sb.y;
+}
+
+/// Returns true if state b (at frame frameB) can be discarded because state a (at frame frameA) exists.
+INLINE bool dominates(const CompressedState* a, FRAME frameA, const CompressedState* b, FRAME frameB)
+{
+	State sa, sb;
+	sa.decompress(a);
+	sb.decompress(b);
+	return sa.x == sb.x && sa.y == sb.y && frameA <= frameB;
+}
+
 // ******************************************************************************************************
 
 /// Defines a move within the problem state graph. Doesn't need to be memory-efficient.
@@ -142,6 +198,12 @@ struct Step
 	}
 };
 
+/// Identifies a step by a number below 255 (only used if TRACE_LAST_ACTION is defined).
+INLINE uint8_t getStepAction(const Step& step)
+{
+	return (uint8_t)step.action;
+}
+
 /// Private function, used in writeSolution below.
 void replayStep(State* state, FRAME* frame, Step step)
 {
@@ -174,6 +236,64 @@ void expandChildren(FRAME frame, const State* state)
 	}
 }
 
+/// Lets the search expand whole chunks of states with expandChildrenBatch (when MULTITHREADING is enabled).
+/// Left off, as it has not been measured to be faster than expandChildren for this maze.
+//#define HAVE_EXPAND_CHILDREN_BATCH
+
+/// Batched version of expandChildren. Expands count (at most QUEUE_CHUNK_SIZE) states at once, and passes all children in one call to:
+/// static void handleChildren(const CompressedState* children, const FRAME* frames, int count)
+template <class CHILD_HANDLER>
+void expandChildrenBatch(const CompressedState states[], const FRAME frames[], int count)
+{
+	// Structure-of-arrays form of the states, so that each action is applied to the whole batch in one loop.
+	int xs[QUEUE_CHUNK_SIZE], ys[QUEUE_CHUNK_SIZE];
+	for (int i=0; i<count; i++)
+	{
+		State s;
+		s.decompress(&states[i]);
+		xs[i] = s.x;
+		ys[i] = s.y;
+	}
+
+	CompressedState children[QUEUE_CHUNK_SIZE * MAX_BRANCHING];
+	FRAME childFrames[QUEUE_CHUNK_SIZE * MAX_BRANCHING];
+	int n = 0;
+	for (Action action = ACTION_FIRST; action <= ACTION_LAST; action++)
+		for (int i=0; i<count; i++)
+		{
+			State child;
+			child.x = xs[i] + DX[action];
+			child.y = ys[i] + DY[action];
+			child.compress(&children[n]);
+			childFrames[n] = frames[i] + 1;
+			n += level[child.y][child.x] != '#'; // overwritten by the next child if it's a wall
+		}
+	CHILD_HANDLER::handleChildren(children, childFrames, n);
+}
+
+/// Lets exit tracing look up the parents of each state in the closed node files (see expandParents below).
+#define HAVE_EXPAND_PARENTS
+
+/// Templated function to enumerate a state's parents (needed for BIDIRECTIONAL_SEARCH, HAVE_PATTERN_DATABASE and HAVE_EXPAND_PARENTS).
+/// Parents are collected via the same handleChild functions as in expandChildren, with "parent" being the given state.
+/// "step" is the forward step that leads from the enumerated state to the given state.
+template <class CHILD_HANDLER>
+void expandParents(FRAME frame, const State* state)
+{
+	for (Action action = ACTION_FIRST; action <= ACTION_LAST; action++)
+	{
+		State newState;
+		newState.x = state->x - DX[action];
+		newState.y = state->y - DY[action];
+		if (level[newState.y][newState.x] != '#')
+		{
+			Step step;
+			step.action = action;
+			CHILD_HANDLER::handleChild(state, frame, step, &newState, frame + 1);
+		}
+	}
+}
+
 // ******************************************************************************************************
 
 /// Specifies file name layout used for data files.
@@ -210,6 +330,24 @@ void writeSolution(const State* initialState, Step steps[], int stepNr)
 State initialStates[MAX_INITIAL_STATES];
 int initialStateCount = 0;
 
+#define MAX_FINISH_STATES 4
+
+/// These set the finish states used to populate frame 0 of the backward search (only needed for BIDIRECTIONAL_SEARCH).
+State finishStates[MAX_FINISH_STATES];
+int finishStateCount = 0;
+
+INLINE int State::lowerBound() const
+{
+	int best = X+Y;
+	for (int i=0; i<finishStateCount; i++)
+	{
+		int distance = abs(x - finishStates[i].x) + abs(y - finishStates[i].y);
+		if (best > distance)
+			best = distance;
+	}
+	return best;
+}
+
 /// Problem initialization function.
 void initProblem()
 {
@@ -223,4 +361,11 @@ void initProblem()
 				initialStates[initialStateCount].y = y;
 				initialStateCount++;
 			}
+			else
+			if (level[y][x] == 'F')
+			{
+				finishStates[finishStateCount].x = x;
+				finishStates[finishStateCount].y = y;
+				finishStateCount++;
+			}
 }
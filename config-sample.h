@@ -1,7 +1,13 @@
 // DEBUG enables asserts and some other debug checks.
 //#define DEBUG
 //#define KEEP_PAST_FILES
+// VERIFY_COMPRESSION checks that every expanded state survives a compress/decompress round trip, and that bit-packed
+// state fields (see PACKED_CODEC) fit in their declared widths. Implied by DEBUG for the round-trip check.
+//#define VERIFY_COMPRESSION
 //#define USE_MEMCMP
+// Compare states of 32 bytes or more with SSE2 (or AVX2, if compiling for it) instead of 64-bit pieces.
+// Only faster when most compared states share long common prefixes (sorting states which differ early is slower).
+//#define USE_SIMD_COMPARE
 #define PRINT_RUNNING_TOTAL_TIME
 
 // Which problem to solve?
@@ -10,18 +16,46 @@
 // Specify the level to solve here.
 //#define LEVEL 18
 
-// An unfinished feature, work in progress; sort new nodes as they are added; eliminates the need to do sorting as a postprocessing step
-// Needs to be supported by PROBLEM; should result in a huge speed boost
+// Store every state in a canonical form (e.g. the smallest of all its mirrored/rotated versions), so that symmetric
+// duplicates are merged during sorting. Exit tracing maps the solution back to the actual states.
+// Needs to be supported by PROBLEM (State::canonicalize); can reduce the number of states by the number of symmetries
 //#define USE_TRANSFORM_INVARIANT_SORTING
 
+// Search from the initial and finish states at the same time, expanding whichever side has the smaller frontier,
+// and stop once the two searches have met at a provably optimal point.
+// Needs to be supported by PROBLEM (expandParents, finishStates/finishStateCount and MAX_FRAME_DELAY or UNIT_COST).
+//#define BIDIRECTIONAL_SEARCH
+
+// Frontier search: drop the nodes lying more than MAX_FRAME_DELAY frames behind the next frame group to expand from the
+// combined node file, as a reversible step can never lead back to them. Keeps the combined node file to the search frontier.
+// Needs to be supported by PROBLEM (REVERSIBLE_MOVES). Not compatible with BIDIRECTIONAL_SEARCH.
+//#define FRONTIER_SEARCH
+
+// Detect exits by merge-joining each closed node file against a sorted and deduplicated file of goal states ("goals.bin",
+// in closed node format), instead of calling State::isFinish for every expanded state.
+//#define USE_GOAL_SET
+
+// Store the action which created each node (getStepAction of its Step, below 255) in a byte of the open and closed nodes.
+// Exit tracing then only needs to look up the one parent reached by undoing that action, instead of all parents of a state.
+// Needs to be supported by PROBLEM (getStepAction and expandParents).
+//#define TRACE_LAST_ACTION
+
+// Write the expanded nodes without their frame, which for a UNIT_COST problem is always the next one; Combining adds it back.
+// Cuts the bytes sorted, merged and written by Expanding and Merging. Not compatible with GROUP_FRAMES.
+// Finish any Merging or Combining step in progress before switching this on or off, as it changes the expanded node files.
+//#define BARE_EXPANDED_NODES
+
 // Use this in combination with DISK_WINFILES to achieve more efficient disk I/O when the data set has gotten very large (however, this is slower with small data sets)
 //#define USE_UNBUFFERED_DISK_IO
 #define DISK_IO_CHUNK_SIZE (16*1024*1024)
 
 // MULTITHREADING will enable threading and synchronization code.
+// THREADS, QUEUE_CHUNK_SIZE, RAM_SIZE, the buffer sizes, DISK_IO_CHUNK_SIZE and EXPANSION_NODES_PER_QUEUE_ELEMENT are only defaults,
+// which can be overridden at run time with command-line options or the options file (see the usage text).
 #define MULTITHREADING
 #define THREADS (1+4)
-#define QUEUE_CHUNK_SIZE 256 // increases the efficiency of multithreading by dequeueing in chunks of this many nodes, reducing the amount of time spent waiting for sync
+//#define MAX_THREADS 64 // the most threads which can be set at run time (default: the larger of 64 and THREADS)
+#define QUEUE_CHUNK_SIZE 256 // increases the efficiency of multithreading by dequeueing in chunks of this many nodes, reducing the amount of time spent waiting for sync; also the most which can be set at run time
 
 // THREAD_* defines how will threads be created.
 #define THREAD_BOOST
@@ -41,6 +75,10 @@
 // How many bytes of RAM to use?
 #define RAM_SIZE (8LL*1024*1024*1024)
 
+// Positions within RAM buffers are 32-bit unless RAM_SIZE holds more than 4G nodes. Define this to always use 64-bit positions,
+// e.g. when --ram-size will be raised beyond that on a multi-terabyte host.
+//#define LARGE_BUFFERS
+
 // How many bytes to use for file stream buffers?
 #define STANDARD_BUFFER_SIZE  (  1*1024*1024 / sizeof(Node)) // allocated separately in heap - used for open node files and other files
 #define CLOSED_IN_BUFFER_SIZE ( 16*1024*1024 / sizeof(Node)) // for input to the Expanding phase
@@ -48,6 +86,11 @@
 // The expected ratio of Merging output/input
 #define EXPECTED_MERGING_RATIO 0.99
 
+// If defined, each worker keeps a HyperLogLog sketch of the children it generates. The merged sketches estimate the number of
+// distinct expanded nodes and of new closed nodes, which replace EXPECTED_MERGING_RATIO and the previous file sizes for sizing the
+// Merging buffers and the preallocated files. The estimates are printed next to the Merging and Combining steps.
+//#define ESTIMATE_CARDINALITY
+
 // If defined, preallocate expanded chunks to this size to avoid disk fragmentation, then truncate them to their actual size upon closing. This
 // dramatically speeds up the Merging step when using magnetic hard drives (as opposed to solid state drives). it requires administrative-level
 // privilege, as the preallocated space contains whatever contents previously occupied that location on disk.
@@ -75,6 +118,14 @@
 #define EXPANSION_BUFFER_FILL_RATIO (1./WORKERS)
 #endif
 
+// If nonzero, save a checkpoint of the Expanding phase every this many seconds, so that an interrupted search resumes the
+// expansion from the last checkpoint instead of the start of the frame group. Each checkpoint ends the current expanded chunk.
+//#define EXPANSION_CHECKPOINT_INTERVAL (60*60)
+
+// If nonzero, save a progress marker of the Merging and Combining phases every this many seconds, so that an interrupted search
+// continues these merges from the marker instead of starting them over.
+//#define MERGE_CHECKPOINT_INTERVAL (60*60)
+
 //#define ALIGN_TO_32BITS
 
 
@@ -87,8 +138,3 @@
 #ifdef DEBUG
 #define NO_DISK_FLUSH
 #endif
-
-// Keep a file with all nodes to filter against, instead of filtering against each individual frame. 
-// The "all" file contains the sorted contents of all "closed" nodes, and needs to be rewritten every frame/frame-group.
-// Enable USE_ALL to use less RAM/CPU and to optimize for sequential disk I/O. Disable USE_ALL if random disk access is very fast.
-#define USE_ALL
@@ -1,5 +1,10 @@
 // Windows files
 
+#ifndef DISK_IO_CHUNK_SIZE
+# define DISK_IO_CHUNK_SIZE (16*1024*1024)
+#endif
+DWORD diskIOChunkSize = DISK_IO_CHUNK_SIZE; // the largest single ReadFile/WriteFile call; set by the --disk-io-chunk-size option
+
 void windowsError(const char* where = NULL)
 {
 	LPVOID lpMsgBuf;
@@ -206,7 +211,7 @@ public:
 		while (bytes < total)
 		{
 			size_t left = total-bytes;
-			DWORD chunk = left > DISK_IO_CHUNK_SIZE ? DISK_IO_CHUNK_SIZE : (DWORD)left;
+			DWORD chunk = left > diskIOChunkSize ? diskIOChunkSize : (DWORD)left;
 			DWORD w;
 			BOOL b;
 			if (sectorBufferUse)
@@ -400,7 +405,7 @@ public:
 		while (bytes < total)
 		{
 			size_t left = total-bytes;
-			DWORD chunk = left > DISK_IO_CHUNK_SIZE ? DISK_IO_CHUNK_SIZE : (DWORD)left;
+			DWORD chunk = left > diskIOChunkSize ? diskIOChunkSize : (DWORD)left;
 			DWORD r = 0;
 			BOOL b;
 			if (sectorBufferPos)
@@ -613,6 +618,82 @@ public:
 	}
 };
 
+/// A read-only view of a whole file, mapped into memory.
+template<class NODE>
+class MappedFile
+{
+	HANDLE archive, mapping;
+	const NODE* view;
+	uint64_t count;
+
+public:
+	MappedFile() : archive(0), mapping(0), view(NULL), count(0) {}
+	~MappedFile() { close(); }
+
+	void open(const char* filename)
+	{
+		assert(archive==0);
+		archive = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+		if (archive == INVALID_HANDLE_VALUE)
+			windowsError(format("File open failure (%s)", filename));
+		ULARGE_INTEGER li;
+		li.LowPart = GetFileSize(archive, &li.HighPart);
+		assert(li.QuadPart % sizeof(NODE) == 0, "Unaligned EOF");
+		count = li.QuadPart / sizeof(NODE);
+		mapping = CreateFileMapping(archive, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+			windowsError(format("File mapping failure (%s)", filename));
+		view = (const NODE*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == NULL)
+			windowsError(format("File mapping failure (%s)", filename));
+	}
+
+	void close()
+	{
+		if (view)
+			UnmapViewOfFile(view);
+		if (mapping)
+			CloseHandle(mapping);
+		if (archive)
+			CloseHandle(archive);
+		archive = mapping = 0;
+		view = NULL;
+		count = 0;
+	}
+
+	const NODE* data() const { return view; }
+	uint64_t size() const { return count; }
+};
+
+/// Alignment of the buffers and request sizes of UncachedInputStream.
+#define UNCACHED_IO_ALIGNMENT 4096
+
+/// Reads a file sequentially past the OS file cache, so that the transfers measure the disk itself (used by autotune).
+/// The buffer address and the request sizes must be multiples of UNCACHED_IO_ALIGNMENT.
+class UncachedInputStream
+{
+	HANDLE archive;
+
+public:
+	UncachedInputStream(const char* filename)
+	{
+		archive = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_NO_BUFFERING, NULL);
+		if (archive == INVALID_HANDLE_VALUE)
+			windowsError(format("File open failure (%s)", filename));
+	}
+
+	~UncachedInputStream() { CloseHandle(archive); }
+
+	/// Returns the number of bytes read, which is 0 at the end of the file.
+	size_t read(void* p, size_t bytes)
+	{
+		DWORD r = 0;
+		if (!ReadFile(archive, p, (DWORD)bytes, &r, NULL) && GetLastError() != ERROR_HANDLE_EOF)
+			windowsError(format("Read error %d", GetLastError()));
+		return r;
+	}
+};
+
 void deleteFile(const char* filename)
 {
 	BOOL b = DeleteFile(filename);
@@ -629,6 +710,18 @@ void renameFile(const char* from, const char* to, bool replaceExisting=false)
 		windowsError(format("Error moving file from %s to %s", from, to));
 }
 
+void truncateFile(const char* filename, uint64_t size)
+{
+	HANDLE archive = CreateFile(filename, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (archive == INVALID_HANDLE_VALUE)
+		windowsError(format("File open failure (%s)", filename));
+	LARGE_INTEGER li;
+	li.QuadPart = size;
+	if (!SetFilePointerEx(archive, li, NULL, FILE_BEGIN) || !SetEndOfFile(archive))
+		windowsError(format("Error truncating file %s", filename));
+	CloseHandle(archive);
+}
+
 bool fileExists(const char* filename)
 {
 	return GetFileAttributes(filename) != INVALID_FILE_ATTRIBUTES;
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <list>
 #include <queue>
+#include <vector>
 
 #ifdef _WIN32
 # include <windows.h>
@@ -178,23 +179,158 @@ void printTime()
 typedef int32_t FRAME;
 typedef int32_t FRAME_GROUP;
 
-#ifdef USE_TRANSFORM_INVARIANT_SORTING
-enum { PREFERRED_STATE_COMPRESSED, PREFERRED_STATE_UNCOMPRESSED, PREFERRED_STATE_TRANSFORM, PREFERRED_STATE_NEITHER };
-#else
 enum { PREFERRED_STATE_COMPRESSED, PREFERRED_STATE_UNCOMPRESSED, PREFERRED_STATE_NEITHER };
-#endif
 
 // ************************************* CompressedState comparison *************************************
 
 #define     PIECE(block,byteoffset,type)      (*(const type*)(((const uint8_t*)&(block))+(byteoffset)))
 #define MASKPIECE(block,byteoffset,type,mask) (*(const type*)(((const uint8_t*)&(block))+(byteoffset))&mask)
 
+// ****************************************** State bit packing *****************************************
+
+// Instead of hand-writing compress/decompress, a problem can list its state's fields with their bit widths:
+//   #define STATE_FIELDS(FIELD) FIELD(x, 4) FIELD(y, 4)
+//   #define COMPRESSED_BITS PACKED_BITS(STATE_FIELDS)
+//   struct CompressedState { uint8_t data[PACKED_BYTES(STATE_FIELDS)]; ... };
+//   struct State { int x, y; ... PACKED_CODEC(STATE_FIELDS) };
+// Fields are packed from the least significant bit, so later fields are more significant in the sort order.
+// Values must be non-negative and fit in their width (at most 64 bits); VERIFY_COMPRESSION checks this.
+
+#define PACKED_FIELD_BITS(name, bits) + (bits)
+#define PACKED_BITS(FIELDS)  (0 FIELDS(PACKED_FIELD_BITS))
+#define PACKED_BYTES(FIELDS) ((PACKED_BITS(FIELDS) +  7) /  8)
+#define PACKED_WORDS(FIELDS) ((PACKED_BITS(FIELDS) + 63) / 64)
+
+INLINE void packField(uint64_t* words, unsigned offset, unsigned bits, uint64_t value)
+{
+	words[offset/64] |= value << (offset%64);
+	if (offset%64 + bits > 64)
+		words[offset/64+1] |= value >> (64 - offset%64);
+}
+
+template<class T>
+INLINE void unpackField(const uint64_t* words, unsigned offset, unsigned bits, T& field)
+{
+	uint64_t value = words[offset/64] >> (offset%64);
+	if (offset%64 + bits > 64)
+		value |= words[offset/64+1] << (64 - offset%64);
+	if (bits < 64)
+		value &= (1ULL << bits) - 1;
+	field = (T)value;
+}
+
+#ifdef VERIFY_COMPRESSION
+# define PACKED_FIELD_VERIFY(name, bits) if ((bits) < 64 && (uint64_t)(name) >> ((bits) % 64)) error(format("State field " #name " (%lld) doesn't fit in %d bits", (long long)(name), (bits)));
+#else
+# define PACKED_FIELD_VERIFY(name, bits)
+#endif
+#define PACKED_FIELD_COMPRESS(name, bits)   PACKED_FIELD_VERIFY(name, bits) packField(words, offset, (bits), (uint64_t)(name)); offset += (bits);
+#define PACKED_FIELD_DECOMPRESS(name, bits) unpackField(words, offset, (bits), name); offset += (bits);
+
+/// Generates the compress and decompress methods of State. The offsets are constant, so the compiler folds them into plain shifts and masks.
+#define PACKED_CODEC(FIELDS)                                              \
+	void compress(CompressedState* s) const                               \
+	{                                                                     \
+		uint64_t words[PACKED_WORDS(FIELDS)] = {0};                       \
+		unsigned offset = 0;                                              \
+		FIELDS(PACKED_FIELD_COMPRESS)                                     \
+		memcpy(s->data, words, PACKED_BYTES(FIELDS));                     \
+	}                                                                     \
+	void decompress(const CompressedState* s)                             \
+	{                                                                     \
+		uint64_t words[PACKED_WORDS(FIELDS)] = {0};                       \
+		memcpy(words, s->data, PACKED_BYTES(FIELDS));                     \
+		unsigned offset = 0;                                              \
+		FIELDS(PACKED_FIELD_DECOMPRESS)                                   \
+	}
+
 // ********************************************** Problem ***********************************************
 
 #include STRINGIZE(PROBLEM/PROBLEM.cpp)
 
 // ************************************ Types dependent on Problem **************************************
 
+#if defined(BIDIRECTIONAL_SEARCH) || defined(HAVE_PATTERN_DATABASE)
+#define BACKWARD_SEARCH // the problem supplies expandParents and finishStates/finishStateCount
+#endif
+
+#if defined(BACKWARD_SEARCH) && !defined(HAVE_EXPAND_PARENTS)
+#define HAVE_EXPAND_PARENTS // exit tracing looks up the parents of each state instead of expanding whole closed node files
+#endif
+
+#ifdef TRACE_LAST_ACTION
+# ifndef HAVE_EXPAND_PARENTS
+#  error TRACE_LAST_ACTION requires the problem to supply expandParents
+# endif
+# ifdef USE_TRANSFORM_INVARIANT_SORTING
+#  error TRACE_LAST_ACTION cannot trace through canonical states
+# endif
+# ifdef ALIGN_TO_32BITS
+#  error TRACE_LAST_ACTION is not supported with ALIGN_TO_32BITS
+# endif
+# undef HAVE_EXPAND_CHILDREN_BATCH // batches are expanded without their steps
+#endif
+
+// ******************************************* Problem traits *******************************************
+
+// The problem may #define any of these to describe itself, which lets the engine skip work that can't matter:
+// UNIT_COST        - every step takes exactly one frame (implies MAX_FRAME_DELAY 1)
+// MAX_FRAME_DELAY  - the largest frame delay of a single step
+// MAX_BRANCHING    - the largest number of children of a single state
+// REVERSIBLE_MOVES - every step can be undone by a step with the same frame delay (requires MAX_FRAME_DELAY)
+
+#ifdef UNIT_COST
+# ifndef MAX_FRAME_DELAY
+#  define MAX_FRAME_DELAY 1
+# elif MAX_FRAME_DELAY != 1
+#  error UNIT_COST problems must have a MAX_FRAME_DELAY of 1
+# endif
+#endif
+
+#if defined(REVERSIBLE_MOVES) && !defined(MAX_FRAME_DELAY)
+#error REVERSIBLE_MOVES requires the problem to define MAX_FRAME_DELAY
+#endif
+
+#if defined(FRONTIER_SEARCH) && !defined(REVERSIBLE_MOVES)
+#error FRONTIER_SEARCH requires the problem to define REVERSIBLE_MOVES
+#endif
+
+#if defined(FRONTIER_SEARCH) && defined(BIDIRECTIONAL_SEARCH)
+#error FRONTIER_SEARCH does not work with BIDIRECTIONAL_SEARCH, which joins against the full combined node file of the other side
+#endif
+
+#if defined(BARE_EXPANDED_NODES) && (!defined(UNIT_COST) || defined(GROUP_FRAMES))
+#error BARE_EXPANDED_NODES requires a UNIT_COST problem, and does not work with GROUP_FRAMES
+#endif
+
+/// The traits above as compile-time constants (0 means unknown), for use in templates and constant conditions.
+struct ProblemTraits
+{
+	enum
+	{
+#ifdef UNIT_COST
+		unitCost = true,
+#else
+		unitCost = false,
+#endif
+#ifdef MAX_FRAME_DELAY
+		maxFrameDelay = MAX_FRAME_DELAY,
+#else
+		maxFrameDelay = 0,
+#endif
+#ifdef MAX_BRANCHING
+		maxBranching = MAX_BRANCHING,
+#else
+		maxBranching = 0,
+#endif
+#ifdef REVERSIBLE_MOVES
+		reversible = true,
+#else
+		reversible = false,
+#endif
+	};
+};
+
 #if   (MAX_FRAMES<0x100)
 #define PACKED_FRAME_BYTES 1
 typedef uint8_t  PACKED_FRAME;
@@ -216,359 +352,121 @@ typedef uint32_t PACKED_FRAME;
 // Note that the optimized comparison operators are incompatible with the memcmp operators, due to the former being "middle-endian" and the latter being big-endian.
 // TODO: relax ranges for !GROUP_FRAMES
 
-#if   (!defined(USE_MEMCMP) && COMPRESSED_BITS >   0 && COMPRESSED_BITS <=   8) // 1 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint8_t) == PIECE(b,0,uint8_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint8_t) != PIECE(b,0,uint8_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint8_t) <  PIECE(b,0,uint8_t); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint8_t) <= PIECE(b,0,uint8_t); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >   8 && COMPRESSED_BITS <=  16) // 2 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint16_t) == PIECE(b,0,uint16_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint16_t) != PIECE(b,0,uint16_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint16_t) <  PIECE(b,0,uint16_t); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint16_t) <= PIECE(b,0,uint16_t); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  16 && COMPRESSED_BITS <=  24) // 3 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) == (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) != (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <  (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <= (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  24 && COMPRESSED_BITS <=  32) // 4 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint32_t) == PIECE(b,0,uint32_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint32_t) != PIECE(b,0,uint32_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint32_t) <  PIECE(b,0,uint32_t); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint32_t) <= PIECE(b,0,uint32_t); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  32 && COMPRESSED_BITS <=  40) // 5 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) == (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) != (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <  (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <= (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  40 && COMPRESSED_BITS <=  48) // 6 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) == (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) != (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <  (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <= (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  48 && COMPRESSED_BITS <=  56) // 7 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) == (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) != (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <  (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <= (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  56 && COMPRESSED_BITS <=  64) // 8 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint64_t) == PIECE(b,0,uint64_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint64_t) != PIECE(b,0,uint64_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint64_t) <  PIECE(b,0,uint64_t); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,0,uint64_t) <= PIECE(b,0,uint64_t); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  64 && COMPRESSED_BITS <=  72) // 9 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) == PIECE(b,0,uint8_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,1,uint64_t) != PIECE(b,1,uint64_t) || PIECE(a,0,uint8_t) != PIECE(b,0,uint8_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,1,uint64_t) <  PIECE(b,1,uint64_t) || 
-                                                                                   (PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) <  PIECE(b,0,uint8_t)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,1,uint64_t) <  PIECE(b,1,uint64_t) || 
-                                                                                   (PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) <= PIECE(b,0,uint8_t)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  72 && COMPRESSED_BITS <=  80) // 10 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) == PIECE(b,0,uint16_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,2,uint64_t) != PIECE(b,2,uint64_t) || PIECE(a,0,uint16_t) != PIECE(b,0,uint16_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,2,uint64_t) <  PIECE(b,2,uint64_t) || 
-                                                                                   (PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) <  PIECE(b,0,uint16_t)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,2,uint64_t) <  PIECE(b,2,uint64_t) || 
-                                                                                   (PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) <= PIECE(b,0,uint16_t)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  80 && COMPRESSED_BITS <=  88) // 11 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) == (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,3,uint64_t) != PIECE(b,3,uint64_t) || (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) != (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,3,uint64_t) <  PIECE(b,3,uint64_t) || 
-                                                                                   (PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <  (MASKPIECE(b,-1,uint32_t,0xFFFFFF00))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,3,uint64_t) <  PIECE(b,3,uint64_t) || 
-                                                                                   (PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <= (MASKPIECE(b,-1,uint32_t,0xFFFFFF00))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  88 && COMPRESSED_BITS <=  96) // 12 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && PIECE(a,0,uint32_t) == PIECE(b,0,uint32_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,4,uint64_t) != PIECE(b,4,uint64_t) || PIECE(a,0,uint32_t) != PIECE(b,0,uint32_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,4,uint64_t) <  PIECE(b,4,uint64_t) || 
-                                                                                   (PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && PIECE(a,0,uint32_t) <  PIECE(b,0,uint32_t)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,4,uint64_t) <  PIECE(b,4,uint64_t) || 
-                                                                                   (PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && PIECE(a,0,uint32_t) <= PIECE(b,0,uint32_t)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS >  96 && COMPRESSED_BITS <= 104) // 13 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) == (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,5,uint64_t) != PIECE(b,5,uint64_t) || (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) != (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,5,uint64_t) <  PIECE(b,5,uint64_t) || 
-                                                                                   (PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <  (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,5,uint64_t) <  PIECE(b,5,uint64_t) || 
-                                                                                   (PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <= (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 104 && COMPRESSED_BITS <= 112) // 14 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) == (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,6,uint64_t) != PIECE(b,6,uint64_t) || (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) != (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,6,uint64_t) <  PIECE(b,6,uint64_t) || 
-                                                                                   (PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <  (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,6,uint64_t) <  PIECE(b,6,uint64_t) || 
-                                                                                   (PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <= (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 112 && COMPRESSED_BITS <= 120) // 15 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) == (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,7,uint64_t) != PIECE(b,7,uint64_t) || (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) != (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,7,uint64_t) <  PIECE(b,7,uint64_t) || 
-                                                                                   (PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <  (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,7,uint64_t) <  PIECE(b,7,uint64_t) || 
-                                                                                   (PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <= (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 120 && COMPRESSED_BITS <= 128) // 16 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && PIECE(a,0,uint64_t) == PIECE(b,0,uint64_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,8,uint64_t) != PIECE(b,8,uint64_t) || PIECE(a,0,uint64_t) != PIECE(b,0,uint64_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,8,uint64_t) <  PIECE(b,8,uint64_t) || 
-                                                                                   (PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && PIECE(a,0,uint64_t) <  PIECE(b,0,uint64_t)); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,8,uint64_t) <  PIECE(b,8,uint64_t) || 
-                                                                                   (PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && PIECE(a,0,uint64_t) <= PIECE(b,0,uint64_t)); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 128 && COMPRESSED_BITS <= 136) // 17 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,9,uint64_t) == PIECE(b,9,uint64_t) &&  PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) == PIECE(b,0,uint8_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,9,uint64_t) != PIECE(b,9,uint64_t) ||  PIECE(a,1,uint64_t) != PIECE(b,1,uint64_t) || PIECE(a,0,uint8_t) != PIECE(b,0,uint8_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,9,uint64_t) <  PIECE(b,9,uint64_t) || 
-                                                                                   (PIECE(a,9,uint64_t) == PIECE(b,9,uint64_t) && (PIECE(a,1,uint64_t) <  PIECE(b,1,uint64_t) ||
-                                                                                                                                  (PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) <  PIECE(b,0,uint8_t)))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,9,uint64_t) <  PIECE(b,9,uint64_t) || 
-                                                                                   (PIECE(a,9,uint64_t) == PIECE(b,9,uint64_t) && (PIECE(a,1,uint64_t) <  PIECE(b,1,uint64_t) ||
-                                                                                                                                  (PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) <= PIECE(b,0,uint8_t)))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 136 && COMPRESSED_BITS <= 144) // 18 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,10,uint64_t) == PIECE(b,10,uint64_t) &&  PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) == PIECE(b,0,uint16_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,10,uint64_t) != PIECE(b,10,uint64_t) ||  PIECE(a,2,uint64_t) != PIECE(b,2,uint64_t) || PIECE(a,0,uint16_t) != PIECE(b,0,uint16_t); }
-//INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return ((PIECE(a,10,uint64_t) ^ PIECE(b,10,uint64_t)) | (PIECE(a,2,uint64_t) ^ PIECE(b,2,uint64_t)) | (PIECE(a,0,uint16_t) ^ PIECE(b,0,uint16_t))) == 0; }
-//INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return ((PIECE(a,10,uint64_t) ^ PIECE(b,10,uint64_t)) | (PIECE(a,2,uint64_t) ^ PIECE(b,2,uint64_t)) | (PIECE(a,0,uint16_t) ^ PIECE(b,0,uint16_t))) != 0; }
-#if 1
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,10,uint64_t) <  PIECE(b,10,uint64_t) || 
-                                                                                   (PIECE(a,10,uint64_t) == PIECE(b,10,uint64_t) && (PIECE(a,2,uint64_t) <  PIECE(b,2,uint64_t) ||
-                                                                                                                                    (PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) <  PIECE(b,0,uint16_t)))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,10,uint64_t) <  PIECE(b,10,uint64_t) || 
-                                                                                   (PIECE(a,10,uint64_t) == PIECE(b,10,uint64_t) && (PIECE(a,2,uint64_t) <  PIECE(b,2,uint64_t) ||
-                                                                                                                                    (PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) <= PIECE(b,0,uint16_t)))); }
-#else
-INLINE int operator< (const CompressedState& a, const CompressedState& b)
-{
-	uint32_t a0 = PIECE(a, 0,uint16_t);
-	uint64_t a1 = PIECE(a, 2,uint64_t);
-	uint64_t a2 = PIECE(a,10,uint64_t);
-	uint32_t b0 = PIECE(b, 0,uint16_t);
-	uint64_t b1 = PIECE(b, 2,uint64_t);
-	uint64_t temp1 = a1;
-	uint64_t temp2 = a2;
-
-#if 0
-	uint64_t b2 = PIECE(b,10,uint64_t);
-
-	bool result;
-
-	__asm__(
-		"cmpl %3, %2;"
-		"sbbq %4, %0;"
-		"sbbq %5, %1;"
-		: // outputs:
-		/*0*/ "=r"(temp1),
-		/*1*/ "=r"(temp2)
-		: // inputs:
-		/*2*/ "r"(a0),
-		/*3*/ "emr"(b0),
-		/*4*/ "emr"(b1),
-		/*5*/ "emr"(b2),
-		"0"(temp1),
-		"1"(temp2)
-		: // clobbers:
-		);
+#ifdef USE_MEMCMP
 
-	return result;
-#else
-	__asm__(
-		"cmpl %3, %2;"
-		"sbbq %4, %0;"
-		"sbbq %5, %1;"
-		: // outputs:
-		/*0*/ "=r"(temp1),
-		/*1*/ "=r"(temp2)
-		: // inputs:
-		/*2*/ "r"(a0),
-		/*3*/ "emr"(b0),
-		/*4*/ "emr"(b1),
-		/*5*/ "er"(0),
-		"0"(temp1),
-		"1"(temp2));
-
-	uint64_t b2 = PIECE(b,10,uint64_t);
-
-	return temp2 < b2;
-#endif
-}
-
-INLINE int operator<=(const CompressedState& b, const CompressedState& a)
-{
-	uint32_t a0 = PIECE(a, 0,uint16_t);
-	uint64_t a1 = PIECE(a, 2,uint64_t);
-	uint64_t a2 = PIECE(a,10,uint64_t);
-	uint32_t b0 = PIECE(b, 0,uint16_t);
-	uint64_t b1 = PIECE(b, 2,uint64_t);
-	uint64_t temp1 = a1;
-	uint64_t temp2 = a2;
-
-	__asm__(
-		"cmpl %3, %2;"
-		"sbbq %4, %0;"
-		"sbbq %5, %1;"
-		: // outputs:
-		/*0*/ "=r"(temp1),
-		/*1*/ "=r"(temp2)
-		: // inputs:
-		/*2*/ "r"(a0),
-		/*3*/ "emr"(b0),
-		/*4*/ "emr"(b1),
-		/*5*/ "er"(0),
-		"0"(temp1),
-		"1"(temp2));
-
-	uint64_t b2 = PIECE(b,10,uint64_t);
-
-	return temp2 >= b2;
-}
-#endif
-
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 144 && COMPRESSED_BITS <= 152) // 19 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,11,uint64_t) == PIECE(b,11,uint64_t) &&  PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) == (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,11,uint64_t) != PIECE(b,11,uint64_t) ||  PIECE(a,3,uint64_t) != PIECE(b,3,uint64_t) || (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) != (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,11,uint64_t) <  PIECE(b,11,uint64_t) || 
-                                                                                   (PIECE(a,11,uint64_t) == PIECE(b,11,uint64_t) && (PIECE(a,3,uint64_t) <  PIECE(b,3,uint64_t) ||
-                                                                                                                                    (PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <  (MASKPIECE(b,-1,uint32_t,0xFFFFFF00))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,11,uint64_t) <  PIECE(b,11,uint64_t) || 
-                                                                                   (PIECE(a,11,uint64_t) == PIECE(b,11,uint64_t) && (PIECE(a,3,uint64_t) <  PIECE(b,3,uint64_t) ||
-                                                                                                                                    (PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <= (MASKPIECE(b,-1,uint32_t,0xFFFFFF00))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 152 && COMPRESSED_BITS <= 160) // 20 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,12,uint64_t) == PIECE(b,12,uint64_t) &&  PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && PIECE(a,0,uint32_t) == PIECE(b,0,uint32_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,12,uint64_t) != PIECE(b,12,uint64_t) ||  PIECE(a,4,uint64_t) != PIECE(b,4,uint64_t) || PIECE(a,0,uint32_t) != PIECE(b,0,uint32_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,12,uint64_t) <  PIECE(b,12,uint64_t) || 
-                                                                                   (PIECE(a,12,uint64_t) == PIECE(b,12,uint64_t) && (PIECE(a,4,uint64_t) <  PIECE(b,4,uint64_t) ||
-                                                                                                                                    (PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && PIECE(a,0,uint32_t) <  PIECE(b,0,uint32_t)))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,12,uint64_t) <  PIECE(b,12,uint64_t) || 
-                                                                                   (PIECE(a,12,uint64_t) == PIECE(b,12,uint64_t) && (PIECE(a,4,uint64_t) <  PIECE(b,4,uint64_t) ||
-                                                                                                                                    (PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && PIECE(a,0,uint32_t) <= PIECE(b,0,uint32_t)))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 160 && COMPRESSED_BITS <= 168) // 21 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,13,uint64_t) == PIECE(b,13,uint64_t) &&  PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) == (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,13,uint64_t) != PIECE(b,13,uint64_t) ||  PIECE(a,5,uint64_t) != PIECE(b,5,uint64_t) || (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) != (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,13,uint64_t) <  PIECE(b,13,uint64_t) || 
-                                                                                   (PIECE(a,13,uint64_t) == PIECE(b,13,uint64_t) && (PIECE(a,5,uint64_t) <  PIECE(b,5,uint64_t) ||
-                                                                                                                                    (PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <  (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,13,uint64_t) <  PIECE(b,13,uint64_t) || 
-                                                                                   (PIECE(a,13,uint64_t) == PIECE(b,13,uint64_t) && (PIECE(a,5,uint64_t) <  PIECE(b,5,uint64_t) ||
-                                                                                                                                    (PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <= (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 168 && COMPRESSED_BITS <= 176) // 22 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,14,uint64_t) == PIECE(b,14,uint64_t) &&  PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) == (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,14,uint64_t) != PIECE(b,14,uint64_t) ||  PIECE(a,6,uint64_t) != PIECE(b,6,uint64_t) || (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) != (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,14,uint64_t) <  PIECE(b,14,uint64_t) || 
-                                                                                   (PIECE(a,14,uint64_t) == PIECE(b,14,uint64_t) && (PIECE(a,6,uint64_t) <  PIECE(b,6,uint64_t) ||
-                                                                                                                                    (PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <  (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,14,uint64_t) <  PIECE(b,14,uint64_t) || 
-                                                                                   (PIECE(a,14,uint64_t) == PIECE(b,14,uint64_t) && (PIECE(a,6,uint64_t) <  PIECE(b,6,uint64_t) ||
-                                                                                                                                    (PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <= (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 176 && COMPRESSED_BITS <= 184) // 23 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,15,uint64_t) == PIECE(b,15,uint64_t) &&  PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) == (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,15,uint64_t) != PIECE(b,15,uint64_t) ||  PIECE(a,7,uint64_t) != PIECE(b,7,uint64_t) || (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) != (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,15,uint64_t) <  PIECE(b,15,uint64_t) || 
-                                                                                   (PIECE(a,15,uint64_t) == PIECE(b,15,uint64_t) && (PIECE(a,7,uint64_t) <  PIECE(b,7,uint64_t) ||
-                                                                                                                                    (PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <  (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,15,uint64_t) <  PIECE(b,15,uint64_t) || 
-                                                                                   (PIECE(a,15,uint64_t) == PIECE(b,15,uint64_t) && (PIECE(a,7,uint64_t) <  PIECE(b,7,uint64_t) ||
-                                                                                                                                    (PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <= (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 184 && COMPRESSED_BITS <= 192) // 24 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,16,uint64_t) == PIECE(b,16,uint64_t) &&  PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && PIECE(a,0,uint64_t) == PIECE(b,0,uint64_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,16,uint64_t) != PIECE(b,16,uint64_t) ||  PIECE(a,8,uint64_t) != PIECE(b,8,uint64_t) || PIECE(a,0,uint64_t) != PIECE(b,0,uint64_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,16,uint64_t) <  PIECE(b,16,uint64_t) || 
-                                                                                   (PIECE(a,16,uint64_t) == PIECE(b,16,uint64_t) && (PIECE(a,8,uint64_t) <  PIECE(b,8,uint64_t) ||
-                                                                                                                                    (PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && PIECE(a,0,uint64_t) <  PIECE(b,0,uint64_t)))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,16,uint64_t) <  PIECE(b,16,uint64_t) || 
-                                                                                   (PIECE(a,16,uint64_t) == PIECE(b,16,uint64_t) && (PIECE(a,8,uint64_t) <  PIECE(b,8,uint64_t) ||
-                                                                                                                                    (PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && PIECE(a,0,uint64_t) <= PIECE(b,0,uint64_t)))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 192 && COMPRESSED_BITS <= 200) // 25 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,17,uint64_t) == PIECE(b,17,uint64_t) &&  PIECE(a,9,uint64_t) == PIECE(b,9,uint64_t) &&  PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) == PIECE(b,0,uint8_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,17,uint64_t) != PIECE(b,17,uint64_t) ||  PIECE(a,9,uint64_t) != PIECE(b,9,uint64_t) ||  PIECE(a,1,uint64_t) != PIECE(b,1,uint64_t) || PIECE(a,0,uint8_t) != PIECE(b,0,uint8_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,17,uint64_t) <  PIECE(b,17,uint64_t) || 
-                                                                                   (PIECE(a,17,uint64_t) == PIECE(b,17,uint64_t) && (PIECE(a,9,uint64_t) <  PIECE(b,9,uint64_t) ||
-                                                                                                                                    (PIECE(a,9,uint64_t) == PIECE(b,9,uint64_t) && (PIECE(a,1,uint64_t) <  PIECE(b,1,uint64_t) ||
-																																	                                               (PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) <  PIECE(b,0,uint8_t)))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,17,uint64_t) <  PIECE(b,17,uint64_t) || 
-                                                                                   (PIECE(a,17,uint64_t) == PIECE(b,17,uint64_t) && (PIECE(a,9,uint64_t) <  PIECE(b,9,uint64_t) ||
-                                                                                                                                    (PIECE(a,9,uint64_t) == PIECE(b,9,uint64_t) && (PIECE(a,1,uint64_t) <  PIECE(b,1,uint64_t) ||
-																																	                                               (PIECE(a,1,uint64_t) == PIECE(b,1,uint64_t) && PIECE(a,0,uint8_t) <= PIECE(b,0,uint8_t)))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 200 && COMPRESSED_BITS <= 208) // 26 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,18,uint64_t) == PIECE(b,18,uint64_t) &&  PIECE(a,10,uint64_t) == PIECE(b,10,uint64_t) &&  PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) == PIECE(b,0,uint16_t); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,18,uint64_t) != PIECE(b,18,uint64_t) ||  PIECE(a,10,uint64_t) != PIECE(b,10,uint64_t) ||  PIECE(a,2,uint64_t) != PIECE(b,2,uint64_t) || PIECE(a,0,uint16_t) != PIECE(b,0,uint16_t); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,18,uint64_t) <  PIECE(b,18,uint64_t) || 
-                                                                                   (PIECE(a,18,uint64_t) == PIECE(b,18,uint64_t) && (PIECE(a,10,uint64_t) <  PIECE(b,10,uint64_t) ||
-                                                                                                                                    (PIECE(a,10,uint64_t) == PIECE(b,10,uint64_t) && (PIECE(a,2,uint64_t) <  PIECE(b,2,uint64_t) ||
-																																	                                                 (PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) <  PIECE(b,0,uint16_t)))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,18,uint64_t) <  PIECE(b,18,uint64_t) || 
-                                                                                   (PIECE(a,18,uint64_t) == PIECE(b,18,uint64_t) && (PIECE(a,10,uint64_t) <  PIECE(b,10,uint64_t) ||
-                                                                                                                                    (PIECE(a,10,uint64_t) == PIECE(b,10,uint64_t) && (PIECE(a,2,uint64_t) <  PIECE(b,2,uint64_t) ||
-																																	                                                 (PIECE(a,2,uint64_t) == PIECE(b,2,uint64_t) && PIECE(a,0,uint16_t) <= PIECE(b,0,uint16_t)))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 208 && COMPRESSED_BITS <= 216) // 27 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,19,uint64_t) == PIECE(b,19,uint64_t) &&  PIECE(a,11,uint64_t) == PIECE(b,11,uint64_t) &&  PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) == (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,19,uint64_t) != PIECE(b,19,uint64_t) ||  PIECE(a,11,uint64_t) != PIECE(b,11,uint64_t) ||  PIECE(a,3,uint64_t) != PIECE(b,3,uint64_t) || (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) != (MASKPIECE(b,-1,uint32_t,0xFFFFFF00)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,19,uint64_t) <  PIECE(b,19,uint64_t) || 
-                                                                                   (PIECE(a,19,uint64_t) == PIECE(b,19,uint64_t) && (PIECE(a,11,uint64_t) <  PIECE(b,11,uint64_t) ||
-                                                                                                                                    (PIECE(a,11,uint64_t) == PIECE(b,11,uint64_t) && (PIECE(a,3,uint64_t) <  PIECE(b,3,uint64_t) ||
-																																	                                                 (PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <  (MASKPIECE(b,-1,uint32_t,0xFFFFFF00))))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,19,uint64_t) <  PIECE(b,19,uint64_t) || 
-                                                                                   (PIECE(a,19,uint64_t) == PIECE(b,19,uint64_t) && (PIECE(a,11,uint64_t) <  PIECE(b,11,uint64_t) ||
-                                                                                                                                    (PIECE(a,11,uint64_t) == PIECE(b,11,uint64_t) && (PIECE(a,3,uint64_t) <  PIECE(b,3,uint64_t) ||
-																																	                                                 (PIECE(a,3,uint64_t) == PIECE(b,3,uint64_t) && (MASKPIECE(a,-1,uint32_t,0xFFFFFF00)) <= (MASKPIECE(b,-1,uint32_t,0xFFFFFF00))))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 216 && COMPRESSED_BITS <= 224) // 28 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,20,uint64_t) == PIECE(b,20,uint64_t) &&  PIECE(a,12,uint64_t) == PIECE(b,12,uint64_t) &&  PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && (PIECE(a,0,uint32_t)) == (PIECE(b,0,uint32_t)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,20,uint64_t) != PIECE(b,20,uint64_t) ||  PIECE(a,12,uint64_t) != PIECE(b,12,uint64_t) ||  PIECE(a,4,uint64_t) != PIECE(b,4,uint64_t) || (PIECE(a,0,uint32_t)) != (PIECE(b,0,uint32_t)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,20,uint64_t) <  PIECE(b,20,uint64_t) || 
-                                                                                   (PIECE(a,20,uint64_t) == PIECE(b,20,uint64_t) && (PIECE(a,12,uint64_t) <  PIECE(b,12,uint64_t) ||
-                                                                                                                                    (PIECE(a,12,uint64_t) == PIECE(b,12,uint64_t) && (PIECE(a,4,uint64_t) <  PIECE(b,4,uint64_t) ||
-																																	                                                 (PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && (PIECE(a,0,uint32_t)) <  (PIECE(b,0,uint32_t))))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,20,uint64_t) <  PIECE(b,20,uint64_t) || 
-                                                                                   (PIECE(a,20,uint64_t) == PIECE(b,20,uint64_t) && (PIECE(a,12,uint64_t) <  PIECE(b,12,uint64_t) ||
-                                                                                                                                    (PIECE(a,12,uint64_t) == PIECE(b,12,uint64_t) && (PIECE(a,4,uint64_t) <  PIECE(b,4,uint64_t) ||
-																																	                                                 (PIECE(a,4,uint64_t) == PIECE(b,4,uint64_t) && (PIECE(a,0,uint32_t)) <= (PIECE(b,0,uint32_t))))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 224 && COMPRESSED_BITS <= 232) // 29 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,21,uint64_t) == PIECE(b,21,uint64_t) &&  PIECE(a,13,uint64_t) == PIECE(b,13,uint64_t) &&  PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) == (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,21,uint64_t) != PIECE(b,21,uint64_t) ||  PIECE(a,13,uint64_t) != PIECE(b,13,uint64_t) ||  PIECE(a,5,uint64_t) != PIECE(b,5,uint64_t) || (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) != (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,21,uint64_t) <  PIECE(b,21,uint64_t) || 
-                                                                                   (PIECE(a,21,uint64_t) == PIECE(b,21,uint64_t) && (PIECE(a,13,uint64_t) <  PIECE(b,13,uint64_t) ||
-                                                                                                                                    (PIECE(a,13,uint64_t) == PIECE(b,13,uint64_t) && (PIECE(a,5,uint64_t) <  PIECE(b,5,uint64_t) ||
-																																	                                                 (PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <  (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL))))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,21,uint64_t) <  PIECE(b,21,uint64_t) || 
-                                                                                   (PIECE(a,21,uint64_t) == PIECE(b,21,uint64_t) && (PIECE(a,13,uint64_t) <  PIECE(b,13,uint64_t) ||
-                                                                                                                                    (PIECE(a,13,uint64_t) == PIECE(b,13,uint64_t) && (PIECE(a,5,uint64_t) <  PIECE(b,5,uint64_t) ||
-																																	                                                 (PIECE(a,5,uint64_t) == PIECE(b,5,uint64_t) && (MASKPIECE(a,-3,uint64_t,0xFFFFFFFFFF000000LL)) <= (MASKPIECE(b,-3,uint64_t,0xFFFFFFFFFF000000LL))))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 224 && COMPRESSED_BITS <= 232) // 29 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,22,uint64_t) == PIECE(b,22,uint64_t) &&  PIECE(a,14,uint64_t) == PIECE(b,14,uint64_t) &&  PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) == (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,22,uint64_t) != PIECE(b,22,uint64_t) ||  PIECE(a,14,uint64_t) != PIECE(b,14,uint64_t) ||  PIECE(a,6,uint64_t) != PIECE(b,6,uint64_t) || (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) != (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,22,uint64_t) <  PIECE(b,22,uint64_t) || 
-                                                                                   (PIECE(a,22,uint64_t) == PIECE(b,22,uint64_t) && (PIECE(a,14,uint64_t) <  PIECE(b,14,uint64_t) ||
-                                                                                                                                    (PIECE(a,14,uint64_t) == PIECE(b,14,uint64_t) && (PIECE(a,6,uint64_t) <  PIECE(b,6,uint64_t) ||
-																																	                                                 (PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <  (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL))))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,22,uint64_t) <  PIECE(b,22,uint64_t) || 
-                                                                                   (PIECE(a,22,uint64_t) == PIECE(b,22,uint64_t) && (PIECE(a,14,uint64_t) <  PIECE(b,14,uint64_t) ||
-                                                                                                                                    (PIECE(a,14,uint64_t) == PIECE(b,14,uint64_t) && (PIECE(a,6,uint64_t) <  PIECE(b,6,uint64_t) ||
-																																	                                                 (PIECE(a,6,uint64_t) == PIECE(b,6,uint64_t) && (MASKPIECE(a,-2,uint64_t,0xFFFFFFFFFFFF0000LL)) <= (MASKPIECE(b,-2,uint64_t,0xFFFFFFFFFFFF0000LL))))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 240 && COMPRESSED_BITS <= 248) // 31 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,23,uint64_t) == PIECE(b,23,uint64_t) &&  PIECE(a,15,uint64_t) == PIECE(b,15,uint64_t) &&  PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) == (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,23,uint64_t) != PIECE(b,23,uint64_t) ||  PIECE(a,15,uint64_t) != PIECE(b,15,uint64_t) ||  PIECE(a,7,uint64_t) != PIECE(b,7,uint64_t) || (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) != (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,23,uint64_t) <  PIECE(b,23,uint64_t) || 
-                                                                                   (PIECE(a,23,uint64_t) == PIECE(b,23,uint64_t) && (PIECE(a,15,uint64_t) <  PIECE(b,15,uint64_t) ||
-                                                                                                                                    (PIECE(a,15,uint64_t) == PIECE(b,15,uint64_t) && (PIECE(a,7,uint64_t) <  PIECE(b,7,uint64_t) ||
-																																	                                                 (PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <  (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL))))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,23,uint64_t) <  PIECE(b,23,uint64_t) || 
-                                                                                   (PIECE(a,23,uint64_t) == PIECE(b,23,uint64_t) && (PIECE(a,15,uint64_t) <  PIECE(b,15,uint64_t) ||
-                                                                                                                                    (PIECE(a,15,uint64_t) == PIECE(b,15,uint64_t) && (PIECE(a,7,uint64_t) <  PIECE(b,7,uint64_t) ||
-																																	                                                 (PIECE(a,7,uint64_t) == PIECE(b,7,uint64_t) && (MASKPIECE(a,-1,uint64_t,0xFFFFFFFFFFFFFF00LL)) <= (MASKPIECE(b,-1,uint64_t,0xFFFFFFFFFFFFFF00LL))))))); }
-#elif (!defined(USE_MEMCMP) && COMPRESSED_BITS > 248 && COMPRESSED_BITS <= 256) // 32 bytes
-INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return PIECE(a,24,uint64_t) == PIECE(b,24,uint64_t) &&  PIECE(a,16,uint64_t) == PIECE(b,16,uint64_t) &&  PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && (PIECE(a,0,uint64_t)) == (PIECE(b,0,uint64_t)); }
-INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return PIECE(a,24,uint64_t) != PIECE(b,24,uint64_t) ||  PIECE(a,16,uint64_t) != PIECE(b,16,uint64_t) ||  PIECE(a,8,uint64_t) != PIECE(b,8,uint64_t) || (PIECE(a,0,uint64_t)) != (PIECE(b,0,uint64_t)); }
-INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return PIECE(a,24,uint64_t) <  PIECE(b,24,uint64_t) || 
-                                                                                   (PIECE(a,24,uint64_t) == PIECE(b,24,uint64_t) && (PIECE(a,16,uint64_t) <  PIECE(b,16,uint64_t) ||
-                                                                                                                                    (PIECE(a,16,uint64_t) == PIECE(b,16,uint64_t) && (PIECE(a,8,uint64_t) <  PIECE(b,8,uint64_t) ||
-																																	                                                 (PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && (PIECE(a,0,uint64_t)) <  (PIECE(b,0,uint64_t))))))); }
-INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return PIECE(a,24,uint64_t) <  PIECE(b,24,uint64_t) || 
-                                                                                   (PIECE(a,24,uint64_t) == PIECE(b,24,uint64_t) && (PIECE(a,16,uint64_t) <  PIECE(b,16,uint64_t) ||
-                                                                                                                                    (PIECE(a,16,uint64_t) == PIECE(b,16,uint64_t) && (PIECE(a,8,uint64_t) <  PIECE(b,8,uint64_t) ||
-																																	                                                 (PIECE(a,8,uint64_t) == PIECE(b,8,uint64_t) && (PIECE(a,0,uint64_t)) <= (PIECE(b,0,uint64_t))))))); }
-#else
-#pragma message("Performance warning: using memcmp for CompressedState comparison")
 #define SLOW_COMPARE
 INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return memcmp(&a, &b, COMPRESSED_BYTES)==0; }
 INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return memcmp(&a, &b, COMPRESSED_BYTES)!=0; }
 INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return memcmp(&a, &b, COMPRESSED_BYTES)< 0; }
 INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return memcmp(&a, &b, COMPRESSED_BYTES)<=0; }
+
+#elif defined(USE_SIMD_COMPARE) && (COMPRESSED_BYTES >= 32)
+
+// Wide states: find the most significant differing byte with vector compares.
+// The result is the same ordering as the piecewise comparison below (the state compared as one little-endian integer).
+
+#define SIMD_COMPARE
+#ifdef _MSC_VER
+# include <intrin.h>
+#else
+# include <immintrin.h>
+#endif
+
+INLINE int highestSetBit(uint32_t x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, x);
+	return (int)index;
+#else
+	return 31 - __builtin_clz(x);
+#endif
+}
+
+/// Returns the offset of the most significant byte in which the two states differ, or -1 if they are equal.
+INLINE int highestDifferingByte(const CompressedState& a, const CompressedState& b)
+{
+	const uint8_t* pa = (const uint8_t*)&a;
+	const uint8_t* pb = (const uint8_t*)&b;
+	int offset = COMPRESSED_BYTES;
+#ifdef __AVX2__
+	for (; offset >= 32; offset -= 32)
+	{
+		uint32_t diff = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(pa+offset-32)), _mm256_loadu_si256((const __m256i*)(pb+offset-32))));
+		if (diff)
+			return offset - 32 + highestSetBit(diff);
+	}
+#endif
+	for (; offset >= 16; offset -= 16)
+	{
+		uint32_t diff = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pa+offset-16)), _mm_loadu_si128((const __m128i*)(pb+offset-16)))) & 0xFFFF;
+		if (diff)
+			return offset - 16 + highestSetBit(diff);
+	}
+	if (offset)
+	{
+		// The remaining low bytes, loaded as a vector starting at the state's beginning
+		uint32_t diff = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)pa), _mm_loadu_si128((const __m128i*)pb))) & ((1u<<offset)-1);
+		if (diff)
+			return highestSetBit(diff);
+	}
+	return -1;
+}
+
+INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return highestDifferingByte(a, b) < 0; }
+INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return highestDifferingByte(a, b) >= 0; }
+INLINE bool operator< (const CompressedState& a, const CompressedState& b) { int i = highestDifferingByte(a, b); return i >= 0 && ((const uint8_t*)&a)[i] < ((const uint8_t*)&b)[i]; }
+INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { int i = highestDifferingByte(a, b); return i <  0 || ((const uint8_t*)&a)[i] < ((const uint8_t*)&b)[i]; }
+
+#else
+
+// The state is split into 64-bit pieces, starting from its end, which are compared from the last one.
+// The remaining 1-7 bytes at the start form the least significant piece. For states narrower than 8 bytes, that piece is read
+// with an unaligned load which starts before the state (the extra bytes are masked out); otherwise, it overlaps the next piece.
+
+/// Returns the lowest BYTES bytes of the state as an integer, for BYTES <= 8. WIDE is set if the state is wider than BYTES.
+template<unsigned BYTES, bool WIDE>
+INLINE uint64_t lowPiece(const CompressedState& s)
+{
+	switch (BYTES)
+	{
+		case 1: return PIECE(s,0,uint8_t);
+		case 2: return PIECE(s,0,uint16_t);
+		case 3: return WIDE ? PIECE(s,0,uint32_t) & 0xFFFFFF : MASKPIECE(s,-1,uint32_t,0xFFFFFF00);
+		case 4: return PIECE(s,0,uint32_t);
+		case 5: return WIDE ? PIECE(s,0,uint64_t) & 0xFFFFFFFFFFLL     : MASKPIECE(s,-3,uint64_t,0xFFFFFFFFFF000000LL);
+		case 6: return WIDE ? PIECE(s,0,uint64_t) & 0xFFFFFFFFFFFFLL   : MASKPIECE(s,-2,uint64_t,0xFFFFFFFFFFFF0000LL);
+		case 7: return WIDE ? PIECE(s,0,uint64_t) & 0xFFFFFFFFFFFFFFLL : MASKPIECE(s,-1,uint64_t,0xFFFFFFFFFFFFFF00LL);
+		default: return PIECE(s,0,uint64_t);
+	}
+}
+
+/// Compares the lowest BYTES bytes of two states.
+template<unsigned BYTES, bool WIDE, bool SPLIT = (BYTES > 8)>
+struct CompressedStateCompare
+{
+	static INLINE bool equal    (const CompressedState& a, const CompressedState& b) { return lowPiece<BYTES,WIDE>(a) == lowPiece<BYTES,WIDE>(b); }
+	static INLINE bool less     (const CompressedState& a, const CompressedState& b) { return lowPiece<BYTES,WIDE>(a) <  lowPiece<BYTES,WIDE>(b); }
+	static INLINE bool lessEqual(const CompressedState& a, const CompressedState& b) { return lowPiece<BYTES,WIDE>(a) <= lowPiece<BYTES,WIDE>(b); }
+};
+
+template<unsigned BYTES, bool WIDE>
+struct CompressedStateCompare<BYTES, WIDE, true>
+{
+	typedef CompressedStateCompare<BYTES-8, true> Rest;
+
+	static INLINE bool equal    (const CompressedState& a, const CompressedState& b) { return PIECE(a,BYTES-8,uint64_t) == PIECE(b,BYTES-8,uint64_t) && Rest::equal(a, b); }
+	static INLINE bool less     (const CompressedState& a, const CompressedState& b) { return PIECE(a,BYTES-8,uint64_t) <  PIECE(b,BYTES-8,uint64_t) ||
+	                                                                                         (PIECE(a,BYTES-8,uint64_t) == PIECE(b,BYTES-8,uint64_t) && Rest::less(a, b)); }
+	static INLINE bool lessEqual(const CompressedState& a, const CompressedState& b) { return PIECE(a,BYTES-8,uint64_t) <  PIECE(b,BYTES-8,uint64_t) ||
+	                                                                                         (PIECE(a,BYTES-8,uint64_t) == PIECE(b,BYTES-8,uint64_t) && Rest::lessEqual(a, b)); }
+};
+
+INLINE bool operator==(const CompressedState& a, const CompressedState& b) { return  CompressedStateCompare<COMPRESSED_BYTES, false>::equal    (a, b); }
+INLINE bool operator!=(const CompressedState& a, const CompressedState& b) { return !CompressedStateCompare<COMPRESSED_BYTES, false>::equal    (a, b); }
+INLINE bool operator< (const CompressedState& a, const CompressedState& b) { return  CompressedStateCompare<COMPRESSED_BYTES, false>::less     (a, b); }
+INLINE bool operator<=(const CompressedState& a, const CompressedState& b) { return  CompressedStateCompare<COMPRESSED_BYTES, false>::lessEqual(a, b); }
+
 #endif
 
 INLINE bool operator> (const CompressedState& a, const CompressedState& b) { return b< a; }
@@ -619,24 +517,20 @@ FRAME_GROUP currentFrameGroup;
 
 // Allocate RAM at start, use it for different purposes depending on what we're doing
 // Even if we won't use all of it, most OSes shouldn't reserve physical RAM for the entire amount
+// RAM_SIZE is only the default; allocateRam moves it to the size set by the --ram-size option
 void* ram = malloc(RAM_SIZE);
 void* ramEnd = (char*)ram + RAM_SIZE;
 
 #ifndef STANDARD_BUFFER_SIZE
 # define STANDARD_BUFFER_SIZE (1024*1024 / sizeof(Node)) // 1 MB
 #endif
-#ifndef ALL_FILE_BUFFER_SIZE
-# define ALL_FILE_BUFFER_SIZE (1024*1024 / sizeof(Node)) // 1 MB
+#ifndef CLOSED_IN_BUFFER_SIZE
+# define CLOSED_IN_BUFFER_SIZE (16*1024*1024 / sizeof(Node)) // 16 MB
 #endif
 #ifndef EXPECTED_MERGING_RATIO
 # define EXPECTED_MERGING_RATIO 0.6
 #endif
 
-#ifndef USE_ALL
-# undef  ALL_FILE_BUFFER_SIZE
-# define ALL_FILE_BUFFER_SIZE 0
-#endif
-
 struct PackedCompressedState
 {
 	uint8_t bytes[COMPRESSED_BYTES];
@@ -647,8 +541,6 @@ struct PackedCompressedState
 	PackedCompressedState& operator =(const CompressedState* state) { return *this = *(PackedCompressedState*)state; }
 };
 
-typedef PackedCompressedState BareNode;
-
 #ifndef ALIGN_TO_32BITS
 # pragma pack( push, 1 )
 #endif
@@ -656,6 +548,9 @@ typedef PackedCompressedState BareNode;
 struct Node
 {
 	PackedCompressedState state;
+#ifdef TRACE_LAST_ACTION
+	uint8_t lastAction; // getStepAction of the step which created the node
+#endif
 #ifdef GROUP_FRAMES
 # ifdef ALIGN_TO_32BITS
 #  if COMPRESSED_BYTES%4 == 1
@@ -676,6 +571,9 @@ struct Node
 struct OpenNode
 {
 	PACKED_FRAME frame;
+#ifdef TRACE_LAST_ACTION
+	uint8_t lastAction;
+#endif
 #ifdef ALIGN_TO_32BITS
 # if (COMPRESSED_BYTES+PACKED_FRAME_BYTES)%4 != 0
 	uint8_t padding[4-(COMPRESSED_BYTES+PACKED_FRAME_BYTES)%4];
@@ -686,6 +584,22 @@ struct OpenNode
 	CompressedState& getState() const { return (CompressedState&)state; }
 };
 
+#ifdef BARE_EXPANDED_NODES
+/// The children written by the Expanding step all belong to the frame after the one being expanded, so they are stored
+/// without it, and Combining adds it back (see CombiningInputStream).
+struct ExpandedNode
+{
+# ifdef TRACE_LAST_ACTION
+	uint8_t lastAction;
+# endif
+	PackedCompressedState state;
+
+	CompressedState& getState() const { return (CompressedState&)state; }
+};
+#else
+typedef OpenNode ExpandedNode;
+#endif
+
 #ifndef ALIGN_TO_32BITS
 # pragma pack( pop )
 #endif
@@ -704,17 +618,380 @@ INLINE bool operator<=(const OpenNode& a, const OpenNode& b) { return a.getState
 INLINE bool operator> (const OpenNode& a, const OpenNode& b) { return a.getState() >  b.getState(); }
 INLINE bool operator>=(const OpenNode& a, const OpenNode& b) { return a.getState() >= b.getState(); }
 
+#ifdef BARE_EXPANDED_NODES
+INLINE bool operator==(const ExpandedNode& a, const ExpandedNode& b) { return a.getState() == b.getState(); }
+INLINE bool operator!=(const ExpandedNode& a, const ExpandedNode& b) { return a.getState() != b.getState(); }
+INLINE bool operator< (const ExpandedNode& a, const ExpandedNode& b) { return a.getState() <  b.getState(); }
+INLINE bool operator<=(const ExpandedNode& a, const ExpandedNode& b) { return a.getState() <= b.getState(); }
+INLINE bool operator> (const ExpandedNode& a, const ExpandedNode& b) { return a.getState() >  b.getState(); }
+INLINE bool operator>=(const ExpandedNode& a, const ExpandedNode& b) { return a.getState() >= b.getState(); }
+#endif
+
 // For deduplication
 #ifdef GROUP_FRAMES
 INLINE unsigned getFrame(const Node* node) { return node->subframe; }
 INLINE void setFrame(Node* node, uint8_t frame) { node->subframe = frame; }
+#elif defined(HAVE_DOMINANCE)
+INLINE unsigned getFrame(const Node* node) { return 0; } // all nodes in a closed node file are from the same frame
 #endif
 INLINE PACKED_FRAME getFrame(const OpenNode* node) { return node->frame; }
 INLINE void setFrame(OpenNode* node, PACKED_FRAME frame) { node->frame = frame; }
+#ifdef BARE_EXPANDED_NODES
+INLINE PACKED_FRAME getFrame(const ExpandedNode* node) { return (PACKED_FRAME)(currentFrameGroup+1); }
+INLINE void setFrame(ExpandedNode* node, PACKED_FRAME frame) { debug_assert(frame == currentFrameGroup+1); }
+#endif
+
+// The action which created a node (see TRACE_LAST_ACTION). Kept together with the frame when deduplicating.
+#ifdef TRACE_LAST_ACTION
+enum { NO_LAST_ACTION = 0xFF }; // initial states
+# define STEP_ACTION(step) getStepAction(step)
+# define SET_LAST_ACTION(node, action) (node).lastAction = (action)
+# define COPY_LAST_ACTION(to, from) (to).lastAction = (from).lastAction
+#else
+# define STEP_ACTION(step) 0
+# define SET_LAST_ACTION(node, action)
+# define COPY_LAST_ACTION(to, from)
+#endif
+
+#ifdef HAVE_DOMINANCE
+
+// The problem may declare that some states make others redundant (e.g. same position, but more items or less time used).
+// sameDominanceKey(a, b) must return true only for states that are adjacent in sort order (i.e. which only differ in their least
+// significant bits), and dominates(a, frameA, b, frameB) must return true if b can be discarded because a exists.
+// Dominated states are removed among runs of deduplicated states with the same dominance key. Only the run's non-dominated
+// states (its front) are kept while it is read, so the work is proportional to the run length times the size of the front.
+// Streaming merges hold back at most --dominance-max-run front states; a front that grows larger is passed on early, which only
+// lets some dominated states survive.
+
+#ifndef DOMINANCE_MAX_RUN
+# define DOMINANCE_MAX_RUN 0x10000
+#endif
+unsigned dominanceMaxRun = DOMINANCE_MAX_RUN;
+
+/// Adds node to the front[0..kept) of non-dominated nodes, unless one of them dominates it, and removes the ones it dominates.
+/// The front stays in the order its nodes were added. Returns the new size of the front.
+template<class NODE>
+INLINE unsigned addNonDominated(NODE* front, unsigned kept, NODE node)
+{
+	for (unsigned j=0; j<kept; j++)
+		if (dominates(&front[j].getState(), getFrame(&front[j]), &node.getState(), getFrame(&node)))
+			return kept;
+	unsigned k = 0;
+	for (unsigned j=0; j<kept; j++)
+		if (!dominates(&node.getState(), getFrame(&node), &front[j].getState(), getFrame(&front[j])))
+			front[k++] = front[j];
+	front[k] = node;
+	return k+1;
+}
+
+/// In-place removal of dominated nodes from a run of nodes with the same dominance key. Returns the new number of nodes.
+template<class NODE>
+unsigned removeDominated(NODE* run, size_t count)
+{
+	unsigned kept = 0;
+	for (size_t i=0; i<count; i++)
+		kept = addNonDominated(run, kept, run[i]);
+	return kept;
+}
+
+/// Collects the front of each run of nodes with the same dominance key, and passes it on when the run ends.
+template<class NODE, class OUTPUT>
+class DominanceFilterOutput
+{
+	OUTPUT* output;
+	NODE* front;
+	unsigned frontSize;
+
+public:
+	DominanceFilterOutput(OUTPUT* output) : output(output), front(new NODE[dominanceMaxRun]), frontSize(0) {}
+	~DominanceFilterOutput() { flush(); delete[] front; }
+
+	INLINE void write(const NODE* node, bool verify=false)
+	{
+		if (frontSize && (frontSize == dominanceMaxRun || !sameDominanceKey(&front[0].getState(), &node->getState())))
+			flush();
+		frontSize = addNonDominated(front, frontSize, *node);
+	}
+
+	void flush()
+	{
+		for (unsigned i=0; i<frontSize; i++)
+			output->write(&front[i], true);
+		frontSize = 0;
+	}
+};
+
+# define DOMINANCE_FILTER_OUTPUT(NODE, OUTPUT, output) DominanceFilterOutput<NODE, OUTPUT> dominanceFilter(output); DominanceFilterOutput<NODE, OUTPUT>* out = &dominanceFilter
+#else
+# define DOMINANCE_FILTER_OUTPUT(NODE, OUTPUT, output) OUTPUT* out = output
+#endif
+
+/// Selects the type of node positions and counts within RAM buffers (buffer sizes, heap nodes and expansion regions).
+/// The compact 32-bit type limits a single buffer to 4G nodes, so hosts with more RAM than that use 64-bit positions.
+template<bool LARGE> struct BufferIndexType       { typedef uint32_t T; };
+template<>           struct BufferIndexType<true> { typedef uint64_t T; };
+
+#ifdef LARGE_BUFFERS
+typedef BufferIndexType<true>::T BUFFER_INDEX;
+#else
+typedef BufferIndexType<(RAM_SIZE / sizeof(Node) > 0xFFFFFFFFLL)>::T BUFFER_INDEX;
+#endif
+
+size_t OPENNODE_BUFFER_SIZE = RAM_SIZE / sizeof(OpenNode);
+size_t EXPANDEDNODE_BUFFER_SIZE = RAM_SIZE / sizeof(ExpandedNode);
+
+// ****************************************** Runtime options *******************************************
+
+// The config.h macros of the same names only set the defaults of these options. They can be changed on the command line
+// (before the command), and in the options file, which is reread at the start of every frame group, so that a running
+// search can be retuned without rebuilding or restarting. The options file contains the same "--name value" pairs.
+
+uint64_t ramSize = RAM_SIZE;
+BUFFER_INDEX standardBufferSize = STANDARD_BUFFER_SIZE; // in nodes
+BUFFER_INDEX closedInBufferSize = CLOSED_IN_BUFFER_SIZE; // in nodes
+unsigned expansionNodesPerQueueElement = EXPANSION_NODES_PER_QUEUE_ELEMENT;
+
+#ifdef MULTITHREADING
+// Only bounds the arrays of per-worker state
+# ifndef MAX_THREADS
+#  define MAX_THREADS (THREADS > 64 ? THREADS : 64)
+# endif
+unsigned threads = THREADS;
+// QUEUE_CHUNK_SIZE remains the compile-time maximum, as it sizes the workers' (and the problem's) batch arrays on the stack
+unsigned queueChunkSize = QUEUE_CHUNK_SIZE;
+#endif
+
+/// Parses a size in bytes, with an optional K, M or G suffix.
+uint64_t parseSize(const char* str)
+{
+	double value;
+	char suffix = 0;
+	if (sscanf(str, "%lf%c", &value, &suffix) < 1 || value < 0)
+		error(format("'%s' is not a valid size", str));
+	switch (suffix)
+	{
+		case 0  :                                       break;
+		case 'K': case 'k': value *= 1024;              break;
+		case 'M': case 'm': value *= 1024*1024;         break;
+		case 'G': case 'g': value *= 1024*1024*1024;    break;
+		default: error(format("'%s' is not a valid size", str));
+	}
+	return (uint64_t)value;
+}
+
+/// Applies one option. Returns false if name is not an option.
+bool setOption(const char* name, const char* value)
+{
+	if (strcmp(name, "--ram-size")==0)
+		ramSize = parseSize(value);
+	else
+	if (strcmp(name, "--standard-buffer-size")==0)
+		standardBufferSize = (BUFFER_INDEX)(parseSize(value) / sizeof(Node));
+	else
+	if (strcmp(name, "--closed-in-buffer-size")==0)
+		closedInBufferSize = (BUFFER_INDEX)(parseSize(value) / sizeof(Node));
+	else
+	if (strcmp(name, "--expansion-nodes-per-queue-element")==0)
+		expansionNodesPerQueueElement = (unsigned)parseSize(value);
+#ifdef HAVE_DOMINANCE
+	else
+	if (strcmp(name, "--dominance-max-run")==0)
+		dominanceMaxRun = (unsigned)parseSize(value);
+#endif
+#ifdef MULTITHREADING
+	else
+	if (strcmp(name, "--threads")==0)
+		threads = (unsigned)parseSize(value);
+	else
+	if (strcmp(name, "--queue-chunk-size")==0)
+		queueChunkSize = (unsigned)parseSize(value);
+#endif
+#ifdef DISK_WINFILES
+	else
+	if (strcmp(name, "--disk-io-chunk-size")==0)
+		diskIOChunkSize = (DWORD)parseSize(value);
+#endif
+	else
+		return false;
+	return true;
+}
+
+/// (Re)allocates "ram" to the size of the --ram-size option. Must not be called while any buffer still uses "ram".
+void allocateRam()
+{
+	if (ram && (uint64_t)((char*)ramEnd - (char*)ram) == ramSize)
+		return;
+	free(ram);
+	ram = malloc((size_t)ramSize);
+	enforce(ram, format("RAM allocation failed (%llu bytes)", ramSize));
+	ramEnd = (char*)ram + ramSize;
+	OPENNODE_BUFFER_SIZE = (size_t)(ramSize / sizeof(OpenNode));
+	EXPANDEDNODE_BUFFER_SIZE = (size_t)(ramSize / sizeof(ExpandedNode));
+}
+
+void checkOptions()
+{
+	enforce(ramSize >= sizeof(OpenNode), "--ram-size is too small");
+	enforce(ramSize / sizeof(Node) == (BUFFER_INDEX)(ramSize / sizeof(Node)), "--ram-size exceeds 4G nodes; define LARGE_BUFFERS");
+	enforce(standardBufferSize, "--standard-buffer-size is too small");
+	enforce(closedInBufferSize, "--closed-in-buffer-size is too small");
+	enforce(expansionNodesPerQueueElement, "--expansion-nodes-per-queue-element must be positive");
+#ifdef HAVE_DOMINANCE
+	enforce(dominanceMaxRun, "--dominance-max-run must be positive");
+#endif
+#ifdef MULTITHREADING
+	enforce(threads >= 2 && threads <= MAX_THREADS, format("--threads must be between 2 and %u", (unsigned)MAX_THREADS));
+	enforce(queueChunkSize >= 1 && queueChunkSize <= QUEUE_CHUNK_SIZE, format("--queue-chunk-size must be between 1 and %u", (unsigned)QUEUE_CHUNK_SIZE));
+#endif
+#ifdef DISK_WINFILES
+	enforce(diskIOChunkSize, "--disk-io-chunk-size must be positive");
+#endif
+}
+
+/// Applies the options file, if present, and allocates "ram" accordingly.
+void loadOptionsFile()
+{
+	const char* filename = formatProblemFileName("options", NULL, "txt");
+	if (fileExists(filename))
+	{
+		FILE* f = fopen(filename, "rt");
+		enforce(f, format("Can't open %s", filename));
+		char name[256], value[256];
+		while (fscanf(f, "%255s", name) == 1)
+		{
+			if (name[0] == '#') // comment
+			{
+				fscanf(f, "%*[^\n]");
+				continue;
+			}
+			if (fscanf(f, "%255s", value) != 1 || !setOption(name, value))
+			{
+				fclose(f);
+				error(format("Invalid option in %s: %s", filename, name));
+			}
+		}
+		fclose(f);
+	}
+	checkOptions();
+	allocateRam();
+}
+
+/// Monotonic clock in microseconds, for measuring the time spent waiting for disk I/O.
+uint64_t microseconds()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return count.QuadPart / frequency.QuadPart * 1000000 + count.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+// The buffers of each step are carved out of "ram" as named sub-arenas (see RamArenas).
+// The most RAM each arena was given at once is printed when the program exits.
+
+struct RamArenaUsage
+{
+	const char* name;
+	uint64_t highWater; // bytes
+};
+RamArenaUsage ramArenaUsage[16];
+int ramArenaCount = 0;
+
+void noteRamArena(const char* name, uint64_t bytes)
+{
+	int i;
+	for (i=0; i<ramArenaCount; i++)
+		if (strcmp(ramArenaUsage[i].name, name)==0)
+			break;
+	if (i == ramArenaCount)
+	{
+		if (ramArenaCount == sizeof(ramArenaUsage)/sizeof(ramArenaUsage[0]))
+			return;
+		ramArenaUsage[ramArenaCount].name = name;
+		ramArenaUsage[ramArenaCount].highWater = 0;
+		ramArenaCount++;
+	}
+	if (ramArenaUsage[i].highWater < bytes)
+		ramArenaUsage[i].highWater = bytes;
+}
+
+void printRamArenas()
+{
+	if (!ramArenaCount)
+		return;
+	printf("RAM high-water marks:");
+	for (int i=0; i<ramArenaCount; i++)
+		printf("%s %s %llu KB", i ? "," : "", ramArenaUsage[i].name, (unsigned long long)((ramArenaUsage[i].highWater + 1023) / 1024));
+	printf("\n");
+}
 
-const size_t BUFFER_SIZE = RAM_SIZE / sizeof(Node);
-const size_t OPENNODE_BUFFER_SIZE = RAM_SIZE / sizeof(OpenNode);
-Node* buffer = (Node*) ram;
+/// Hands out consecutive slices of "ram" to the buffers of one step. Slices with the same name add up to one arena.
+class RamArenas
+{
+	char* next;
+	const char* names[8];
+	uint64_t bytes[8];
+	int count;
+
+public:
+	RamArenas() : next((char*)ram), count(0) {}
+
+	template<class NODE>
+	NODE* allocate(const char* name, size_t nodes)
+	{
+		NODE* p = (NODE*)next;
+		next += (nodes * sizeof(NODE) + 7) & ~(size_t)7;
+		assert(next <= (char*)ramEnd, "RAM arenas exceed the RAM size");
+
+		int i;
+		for (i=0; i<count; i++)
+			if (strcmp(names[i], name)==0)
+				break;
+		if (i == count && count < 8)
+		{
+			names[count] = name;
+			bytes[count] = 0;
+			count++;
+		}
+		if (i < count)
+		{
+			bytes[i] += nodes * sizeof(NODE);
+			noteRamArena(name, bytes[i]);
+		}
+		return p;
+	}
+
+	/// Buffer nodes of type NODE which haven't been handed out yet.
+	template<class NODE>
+	size_t remaining()
+	{
+		return ((char*)ram + OPENNODE_BUFFER_SIZE * sizeof(OpenNode) - next) / sizeof(NODE);
+	}
+};
+
+/// Disk transfer counters of one buffered stream, used by the RAM budget planner.
+struct IOStats
+{
+	uint64_t transfers, bytes, microseconds;
+	IOStats() : transfers(0), bytes(0), microseconds(0) {}
+
+	/// The transfers made since the stats were "before".
+	IOStats since(const IOStats& before) const
+	{
+		IOStats delta;
+		delta.transfers    = transfers    - before.transfers;
+		delta.bytes        = bytes        - before.bytes;
+		delta.microseconds = microseconds - before.microseconds;
+		return delta;
+	}
+};
 
 // ****************************************** Buffered streams ******************************************
 
@@ -723,9 +1000,10 @@ class Buffer
 {
 public:
 	NODE* buf;
-	uint32_t size;
+	BUFFER_INDEX size;
+	bool owned; // false if buf points into "ram", which may have been reallocated since
 
-	Buffer(uint32_t size) : size(size), buf(NULL)
+	Buffer(BUFFER_INDEX size) : size(size), buf(NULL), owned(false)
 	{
 	}
 
@@ -733,33 +1011,40 @@ public:
 	void allocate()
 	{
 		if (!buf && size)
+		{
 			buf = new NODE[size];
+			owned = true;
+		}
 	}
 
 	// When we need to use the default constructor (e.g. arrays)
-	void setSize(uint32_t newSize)
+	void setSize(BUFFER_INDEX newSize)
 	{
 		assert(!buf, "Trying to set the buffer size after the buffer was allocated");
 		size = newSize;
 	}
 
-	void reallocate(uint32_t newSize)
+	void reallocate(BUFFER_INDEX newSize)
 	{
 		if (size != newSize)
 		{
 			deallocate();
 			size = newSize;
 			if (size)
+			{
 				buf = new NODE[size];
+				owned = true;
+			}
 		}
 	}
 
-	void assign(NODE* newBuf, uint32_t newSize)
+	void assign(NODE* newBuf, BUFFER_INDEX newSize)
 	{
 		deallocate();
 		assert(newBuf >= ram && newBuf < ramEnd);
 		buf = newBuf;
 		size = newSize;
+		owned = false;
 	}
 
 	void clear()
@@ -772,9 +1057,10 @@ public:
 	{
 		if (buf)
 		{
-			if (buf < ram || buf >= ramEnd)
+			if (owned)
 				delete[] buf;
 			buf = NULL;
+			owned = false;
 		}
 	}
 
@@ -789,8 +1075,10 @@ class BufferedStreamBase
 {
 protected:
 	STREAM s;
+	IOStats io;
 
 public:
+	const IOStats& ioStats() { return io; }
 	uint64_t size() { return s.size(); }
 	bool isOpen() { return s.isOpen(); }
 	void close() { return s.close(); }
@@ -799,11 +1087,12 @@ public:
 template<class STREAM, class NODE>
 class WriteBuffer : virtual public BufferedStreamBase<STREAM>
 {
-	uint32_t pos;
+	BUFFER_INDEX pos;
 protected:
 	Buffer<NODE> buffer;
+	uint64_t flushed; // nodes written to the stream (the file size may differ due to preallocation)
 public:
-	WriteBuffer(uint32_t size) : buffer(size), pos(0) {}
+	WriteBuffer(BUFFER_INDEX size) : buffer(size), pos(0), flushed(0) {}
 
 	void write(const NODE* p, bool verify=false)
 	{
@@ -821,6 +1110,12 @@ public:
 		return s.size() + pos;
 	}
 
+	/// The number of nodes in the stream after all written nodes are flushed.
+	uint64_t position()
+	{
+		return flushed + pos;
+	}
+
 	void clearBuffer()
 	{
 		buffer.clear();
@@ -835,7 +1130,12 @@ public:
 	{
 		if (pos)
 		{
+			uint64_t start = microseconds();
 			s.write(buffer.buf, pos);
+			this->io.transfers++;
+			this->io.bytes += pos * sizeof(NODE);
+			this->io.microseconds += microseconds() - start;
+			flushed += pos;
 			pos = 0;
 		}
 	}
@@ -859,13 +1159,13 @@ public:
 		flushBuffer();
 	}
 
-	void setWriteBuffer(NODE* buf, uint32_t size)
+	void setWriteBuffer(NODE* buf, BUFFER_INDEX size)
 	{
 		flushBuffer();
 		buffer.assign(buf, size);
 	}
 
-	void setWriteBufferSize(uint32_t size)
+	void setWriteBufferSize(BUFFER_INDEX size)
 	{
 		flushBuffer();
 		buffer.reallocate(size);
@@ -877,11 +1177,11 @@ public:
 template<class STREAM, class NODE>
 class ReadBuffer : virtual public BufferedStreamBase<STREAM>
 {
-	uint32_t pos, end;
+	BUFFER_INDEX pos, end;
 protected:
 	Buffer<NODE> buffer;
 public:
-	ReadBuffer(uint32_t size) : buffer(size), pos(0), end(0) {}
+	ReadBuffer(BUFFER_INDEX size) : buffer(size), pos(0), end(0) {}
 
 	const NODE* read()
 	{
@@ -901,18 +1201,22 @@ public:
 	void fillBuffer()
 	{
 		pos = 0;
+		uint64_t start = microseconds();
 		uint64_t left = s.size() - s.position();
-		end = (uint32_t)s.read(buffer.buf, (size_t)(left < buffer.size ? left : buffer.size));
+		end = (BUFFER_INDEX)s.read(buffer.buf, (size_t)(left < buffer.size ? left : buffer.size));
+		this->io.transfers++;
+		this->io.bytes += end * sizeof(NODE);
+		this->io.microseconds += microseconds() - start;
 	}
 
-	void setReadBuffer(NODE* buf, uint32_t size)
+	void setReadBuffer(NODE* buf, BUFFER_INDEX size)
 	{
 		assert(pos == end, "Buffer is dirty");
 		buffer.assign(buf, size);
 	}
 
 	// Useable only before allocation
-	void setReadBufferSize(uint32_t size)
+	void setReadBufferSize(BUFFER_INDEX size)
 	{
 		buffer.setSize(size);
 	}
@@ -923,8 +1227,21 @@ public:
 		pos--;
 	}
 
-	// some InputHeap compatibility
-	INLINE const NODE* getHead()
+	void seek(uint64_t position)
+	{
+		s.seek(position);
+		pos = end = 0;
+	}
+
+	/// Returns the position of the node last returned by read() (or the end of the stream, if it was reached).
+	/// For merge inputs, this is the first node which hasn't been consumed yet.
+	uint64_t headPosition()
+	{
+		return s.position() - end + pos - (pos ? 1 : 0);
+	}
+
+	// some InputHeap compatibility
+	INLINE const NODE* getHead()
 	{
 		if (pos == 0)
 			return NULL;
@@ -1011,8 +1328,8 @@ template<class NODE>
 class BufferedInputStream : public ReadBuffer<InputStream<NODE>, NODE>
 {
 public:
-	BufferedInputStream(uint32_t size = STANDARD_BUFFER_SIZE) : ReadBuffer(size) {}
-	BufferedInputStream(const char* filename, uint32_t size = STANDARD_BUFFER_SIZE) : ReadBuffer(size) { open(filename); }
+	BufferedInputStream(BUFFER_INDEX size = standardBufferSize) : ReadBuffer(size) {}
+	BufferedInputStream(const char* filename, BUFFER_INDEX size = standardBufferSize) : ReadBuffer(size) { open(filename); }
 	void open(const char* filename) { s.open(filename); buffer.allocate(); }
 };
 
@@ -1020,9 +1337,9 @@ template<class NODE>
 class BufferedOutputStream : public WriteBuffer<OutputStream<NODE>, NODE>
 {
 public:
-	BufferedOutputStream(uint32_t size = STANDARD_BUFFER_SIZE) : WriteBuffer(size) {}
-	BufferedOutputStream(const char* filename, bool resume=false, uint32_t size = STANDARD_BUFFER_SIZE) : WriteBuffer(size) { open(filename, resume); }
-	void open(const char* filename, bool resume=false) { s.open(filename, resume); buffer.allocate(); }
+	BufferedOutputStream(BUFFER_INDEX size = standardBufferSize) : WriteBuffer(size) {}
+	BufferedOutputStream(const char* filename, bool resume=false, BUFFER_INDEX size = standardBufferSize) : WriteBuffer(size) { open(filename, resume); }
+	void open(const char* filename, bool resume=false) { s.open(filename, resume); buffer.allocate(); this->flushed = resume ? s.size() : 0; }
 #if defined(PREALLOCATE_EXPANDED) || defined(PREALLOCATE_COMBINING)
 	void preallocate(uint64_t size) { s.preallocate(size); }
 #endif
@@ -1032,8 +1349,8 @@ template<class NODE>
 class BufferedRewriteStream : public ReadBuffer<RewriteStream<NODE>, NODE>, public WriteBuffer<RewriteStream<NODE>, NODE>
 {
 public:
-	BufferedRewriteStream(uint32_t readSize = STANDARD_BUFFER_SIZE, uint32_t writeSize = STANDARD_BUFFER_SIZE) : ReadBuffer(readSize), WriteBuffer(writeSize) {}
-	BufferedRewriteStream(const char* filename, uint32_t readSize = STANDARD_BUFFER_SIZE, uint32_t writeSize = STANDARD_BUFFER_SIZE) : ReadBuffer(readSize), WriteBuffer(writeSize) { open(filename); }
+	BufferedRewriteStream(BUFFER_INDEX readSize = standardBufferSize, BUFFER_INDEX writeSize = standardBufferSize) : ReadBuffer(readSize), WriteBuffer(writeSize) {}
+	BufferedRewriteStream(const char* filename, BUFFER_INDEX readSize = standardBufferSize, BUFFER_INDEX writeSize = standardBufferSize) : ReadBuffer(readSize), WriteBuffer(writeSize) { open(filename); }
 	void open(const char* filename) { s.open(filename); ReadBuffer<RewriteStream>::buffer.allocate(); WriteBuffer<RewriteStream>::buffer.allocate(); }
 	void truncate() { s.truncate(); }
 };
@@ -1091,7 +1408,7 @@ public:
 	}
 };
 
-#if 0
+/// Reads the node range [start, end) of a file.
 template<class NODE>
 class SplitInputStream : public InputStream<NODE>
 {
@@ -1099,9 +1416,7 @@ private:
 	uint64_t start, end;
 	uint64_t pos;
 public:
-	SplitInputStream() : InputStream(), start(0), end(0), pos(0) {}
-
-	SplitInputStream(InputStream<NODE>& _stream, uint64_t _start, uint64_t _end) : InputStream(filename), start(_start), end(_end), pos(_start) {}
+	SplitInputStream() : InputStream<NODE>(), start(0), end(0), pos(0) {}
 
 	void open(const char* filename, uint64_t _start, uint64_t _end)
 	{
@@ -1109,10 +1424,10 @@ public:
 		end = _end;
 		pos = _start;
 
-		InputStream::open(filename);
-		assert(end <= InputStream::size());
+		InputStream<NODE>::open(filename);
+		assert(end <= InputStream<NODE>::size());
 		if (start != 0)
-			InputStream::seek(start);
+			InputStream<NODE>::seek(start);
 	}
 
 	uint64_t size()
@@ -1130,14 +1445,14 @@ public:
 		pos = start + _pos;
 		if (pos > end)
 			pos = end;
-		InputStream::seek(pos);
+		InputStream<NODE>::seek(pos);
 	}
 
 	size_t read(NODE* p, size_t n)
 	{
 		if (n > end - pos)
-			n = end - pos;
-		n = InputStream::read(p, n);
+			n = (size_t)(end - pos);
+		n = InputStream<NODE>::read(p, n);
 		pos += n;
 		return n;
 	}
@@ -1147,25 +1462,26 @@ template<class NODE>
 class BufferedSplitInputStream : public ReadBuffer<SplitInputStream<NODE>, NODE>
 {
 public:
-	BufferedSplitInputStream(uint32_t size = STANDARD_BUFFER_SIZE) : ReadBuffer(size) {}
-	BufferedSplitInputStream(InputStream<NODE>& stream, uint64_t start, uint64_t end, uint32_t size = STANDARD_BUFFER_SIZE) : ReadBuffer(size) { open(stream, start, end); }
+	BufferedSplitInputStream(BUFFER_INDEX size = standardBufferSize) : ReadBuffer(size) {}
+	BufferedSplitInputStream(const char* filename, uint64_t start, uint64_t end, BUFFER_INDEX size = standardBufferSize) : ReadBuffer(size) { open(filename, start, end); }
 	void open(const char* filename, uint64_t start, uint64_t end) { s.open(filename, start, end); buffer.allocate(); }
 };
 
+#if 0
 template<class NODE, unsigned PIECES>
 class BufferedSplitInputStreamSet
 {
 private:
 	BufferedSplitInputStream<NODE> bufferedStream[PIECES];
 public:
-	void setReadBuffer(NODE* buf, uint32_t size)
+	void setReadBuffer(NODE* buf, BUFFER_INDEX size)
 	{
-		uint32_t pos = 0;
-		uint32_t numerator;
+		BUFFER_INDEX pos = 0;
+		BUFFER_INDEX numerator;
 		unsigned i;
 		for (i=0, numerator=size; i<PIECES; i++, numerator+=size)
 		{
-			uint32_t endPos = numerator / PIECES;
+			BUFFER_INDEX endPos = numerator / PIECES;
 			bufferedStream[i].setReadBuffer(buf + pos, endPos - pos);
 			pos = endPos;
 		}
@@ -1202,25 +1518,11 @@ public:
 };
 #endif
 
-template<class NODE>
-void copyFile(const char* from, const char* to)
-{
-	InputStream<NODE> input(from);
-	OutputStream<NODE> output(to);
-	uint64_t amount = input.size();
-	if (amount > BUFFER_SIZE)
-		amount = BUFFER_SIZE;
-	size_t records;
-	while (records = input.read(buffer, (size_t)amount))
-		output.write(buffer, records);
-	output.flush(); // force disk flush
-}
-
 // ***************************************** Hybrid operations ******************************************
 
 struct HeapNode
 {
-	unsigned pos, end;
+	BUFFER_INDEX pos, end;
 };
 
 template<class NODE>
@@ -1232,7 +1534,7 @@ public:
 	bool operator() (const HeapNode& a, const HeapNode& b) { return input[a.pos] < input[b.pos]; }
 };
 
-template<class NODE, unsigned CHUNK_SIZE>
+template<class NODE>
 class InputHeapChunked : public InputOffset<NODE>
 {
 protected:
@@ -1240,17 +1542,17 @@ protected:
 	int size;
 
 public:
-	InputHeapChunked(NODE* input, unsigned inputSize)
+	InputHeapChunked(NODE* input, BUFFER_INDEX inputSize, unsigned chunkSize)
 	{
 		if (inputSize==0)
 			error("No inputs");
-		heap = new HeapNode[(inputSize + CHUNK_SIZE-1) / CHUNK_SIZE];
+		heap = new HeapNode[(inputSize + chunkSize-1) / chunkSize];
 		size = 0;
 		this->input = input;
-		for (unsigned pos=0;;)
+		for (BUFFER_INDEX pos=0;;)
 		{
 			heap[size].pos = pos;
-			pos += CHUNK_SIZE;
+			pos += chunkSize;
 			if (pos >= inputSize)
 			{
 				heap[size++].end = inputSize;
@@ -1352,16 +1654,17 @@ public:
 	}
 };
 
-template<class NODE, unsigned CHUNK_SIZE, class OUTPUT>
-void mergeChunks(NODE* input, unsigned inputSize, OUTPUT* output)
+template<class NODE, class OUTPUT>
+void mergeChunks(NODE* input, BUFFER_INDEX inputSize, unsigned chunkSize, OUTPUT* output)
 {
-	InputHeapChunked<NODE, CHUNK_SIZE> heap(input, inputSize);
+	InputHeapChunked<NODE> heap(input, inputSize, chunkSize);
 
 	const NODE* first = heap.read();
 	if (!first)
 		return;
 	NODE cs = *(NODE*)first;
 	const NODE* cs2;
+	DOMINANCE_FILTER_OUTPUT(NODE, OUTPUT, output);
 
 	while (cs2 = heap.read())
 	{
@@ -1369,27 +1672,31 @@ void mergeChunks(NODE* input, unsigned inputSize, OUTPUT* output)
 		if (cs == *cs2) // CompressedState::operator== does not compare subframe
 		{
 			if (getFrame(&cs) > getFrame(cs2)) // in case of duplicate frames, pick the one from the smallest frame
+			{
 				setFrame(&cs,   getFrame(cs2));
+				COPY_LAST_ACTION(cs, *cs2);
+			}
 		}
 		else
 		{
-			output->write(&cs, true);
+			out->write(&cs, true);
 			cs = *cs2;
 		}
 	}
-	output->write(&cs, true);
+	out->write(&cs, true);
 }
 
-template<class NODE, unsigned CHUNK_SIZE, class OUTPUT>
+template<class NODE, class OUTPUT>
 void mergeChunks(NODE* inputBase, HeapNode* inputHeap, unsigned count, OUTPUT* output)
 {
-	InputHeapChunked<NODE, CHUNK_SIZE> heap(inputBase, inputHeap, count);
+	InputHeapChunked<NODE> heap(inputBase, inputHeap, count);
 
 	const NODE* first = heap.read();
 	if (!first)
 		return;
 	NODE cs = *(NODE*)first;
 	const NODE* cs2;
+	DOMINANCE_FILTER_OUTPUT(NODE, OUTPUT, output);
 
 	while (cs2 = heap.read())
 	{
@@ -1397,15 +1704,18 @@ void mergeChunks(NODE* inputBase, HeapNode* inputHeap, unsigned count, OUTPUT* o
 		if (cs == *cs2) // CompressedState::operator== does not compare subframe
 		{
 			if (getFrame(&cs) > getFrame(cs2)) // in case of duplicate frames, pick the one from the smallest frame
+			{
 				setFrame(&cs,   getFrame(cs2));
+				COPY_LAST_ACTION(cs, *cs2);
+			}
 		}
 		else
 		{
-			output->write(&cs, true);
+			out->write(&cs, true);
 			cs = *cs2;
 		}
 	}
-	output->write(&cs, true);
+	out->write(&cs, true);
 }
 
 // ***************************************** Stream operations ******************************************
@@ -1616,8 +1926,16 @@ void copyStream(INPUT* input, OUTPUT* output)
 		output->write(node, false);
 }
 
-template<class NODE, class INPUT, class OUTPUT>
-void mergeStreams(INPUT inputs[], int inputCount, OUTPUT* output)
+/// Default progress handler for mergeStreams, which never saves progress (see MergeProgress).
+class NoMergeProgress
+{
+public:
+	INLINE bool due() { return false; }
+	template<class NODE, class INPUT> void save(const NODE* key, INPUT inputs[], int inputCount) {}
+};
+
+template<class NODE, class INPUT, class OUTPUT, class PROGRESS>
+void mergeStreams(INPUT inputs[], int inputCount, OUTPUT* output, PROGRESS* progress)
 {
 	InputHeap<INPUT, NODE> heap(inputs, inputCount);
 
@@ -1626,6 +1944,7 @@ void mergeStreams(INPUT inputs[], int inputCount, OUTPUT* output)
 		return;
 	NODE cs = *(NODE*)first;
 	const NODE* cs2;
+	DOMINANCE_FILTER_OUTPUT(NODE, OUTPUT, output);
 	
 	while (cs2 = heap.read())
 	{
@@ -1633,40 +1952,34 @@ void mergeStreams(INPUT inputs[], int inputCount, OUTPUT* output)
 		if (cs == *cs2) // CompressedState::operator== does not compare subframe
 		{
 			if (getFrame(&cs) > getFrame(cs2)) // in case of duplicate frames, pick the one from the smallest frame
+			{
 				setFrame(&cs,   getFrame(cs2));
+				COPY_LAST_ACTION(cs, *cs2);
+			}
 		}
 		else
 		{
-			output->write(&cs, true);
+			out->write(&cs, true);
 			cs = *cs2;
+			if (progress->due())
+			{
+				// All nodes before cs have been passed to the output
+#ifdef HAVE_DOMINANCE
+				out->flush();
+#endif
+				progress->save(&cs, inputs, inputCount);
+			}
 		}
 	}
-	output->write(&cs, true);
+	out->write(&cs, true);
 }
 
-#if 0
-void mergeStreams(BufferedInputStream<Node> inputs[], int inputCount, BufferedOutputStream<BareNode>* output)
+template<class NODE, class INPUT, class OUTPUT>
+void mergeStreams(INPUT inputs[], int inputCount, OUTPUT* output)
 {
-	InputHeap<BufferedInputStream<Node>, Node> heap(inputs, inputCount);
-
-	const CompressedState* first = heap.read();
-	if (!first)
-		return;
-	CompressedState cs = *first;
-	const CompressedState* cs2;
-	
-	while (cs2 = heap.read())
-	{
-		debug_assert(*cs2 >= cs);
-		if (cs != *cs2) // CompressedState::operator!= does not compare subframe
-		{
-			output->write(&(BareNode&)cs, true);
-			cs = *cs2;
-		}
-	}
-	output->write(&(BareNode&)cs, true);
+	NoMergeProgress progress;
+	mergeStreams<NODE>(inputs, inputCount, output, &progress);
 }
-#endif
 
 class NullOutput
 {	
@@ -1691,50 +2004,6 @@ public:
 	INLINE B* b() { return this; }
 };
 
-template<class CLOSED, class MERGED, class NODE>
-void filterStreams(CLOSED* closed, BufferedRewriteStream<NODE> open[], int openCount, MERGED* merged)
-{
-	if (openCount==0)
-	{
-		copyStream(closed, merged);
-		return;
-	}
-	
-	InputHeap<BufferedRewriteStream> openHeap(open, openCount);
-	openHeap.next();
-
-	bool done = false;
-	while (!done)
-	{
-		CompressedState o = *openHeap.getHead();
-		FRAME lowestFrame = MAX_FRAMES;
-		do
-		{
-			FRAME_GROUP group = (FRAME_GROUP)(openHeap.getHeadInput() - open);
-			FRAME frame = GET_FRAME(group, *openHeap.getHead());
-			if (lowestFrame > frame)
-				lowestFrame = frame;
-			if (!openHeap.next())
-			{
-				done = true;
-				break;
-			}
-			if (o > *openHeap.getHead())
-				error(format("Unsorted open node file for frame" GROUP_STR " " GROUP_FORMAT "/" GROUP_FORMAT, group, openHeap.getHeadInput() - open));
-		} while (o == *openHeap.getHead());
-
-		int r = closed->scanTo<false>(&o, merged);
-		if (r == 0)
-			closed->next();
-		else
-		{
-			SET_SUBFRAME(o, lowestFrame);
-			open[lowestFrame/FRAMES_PER_GROUP].write(&o, true);
-		}
-		merged->write(&o, true);
-	}
-}
-
 // In-place deduplicate sorted nodes in memory. Return new number of nodes.
 template<class COMPRESSED_STATE>
 size_t deduplicate(COMPRESSED_STATE* start, size_t records)
@@ -1750,7 +2019,10 @@ size_t deduplicate(COMPRESSED_STATE* start, size_t records)
 		{
 #ifdef GROUP_FRAMES
 			if (getFrame(write-1) > getFrame(read))
+			{
 				setFrame(write-1,   getFrame(read));
+				COPY_LAST_ACTION(write[-1], *read);
+			}
 #endif
 		}
 		else
@@ -1760,6 +2032,20 @@ size_t deduplicate(COMPRESSED_STATE* start, size_t records)
 		}
         read++;
 	}
+#ifdef HAVE_DOMINANCE
+	end = write;
+	read = write = start;
+	while (read < end)
+	{
+		COMPRESSED_STATE* runEnd = read+1;
+		while (runEnd < end && sameDominanceKey(&read->getState(), &runEnd->getState()))
+			runEnd++;
+		unsigned count = removeDominated(read, (size_t)(runEnd-read));
+		memmove(write, read, count * sizeof(COMPRESSED_STATE));
+		write += count;
+		read = runEnd;
+	}
+#endif
 	return write-start;
 }
 
@@ -1770,21 +2056,34 @@ const char* formatFileName(const char* name)
 	return formatProblemFileName(name, NULL, "bin");
 }
 
+#ifdef BACKWARD_SEARCH
+// Per-frame-group files of the backward search are distinguished by this prefix (see switchSearchSide, buildPatternDatabase).
+const char* searchFileNamePrefix = "";
+bool searchBackward = false;
+#ifdef HAVE_PATTERN_DATABASE
+bool searchAbstract = false; // project all new states to their abstraction (see buildPatternDatabase)
+#endif
+# define SEARCH_FILE_NAME(name) format("%s%s", searchFileNamePrefix, name)
+#else
+# define SEARCH_FILE_NAME(name) (name)
+#endif
+
 const char* formatFileName(const char* name, FRAME_GROUP g)
 {
-	return formatProblemFileName(name, format(GROUP_FORMAT, g), "bin");
+	return formatProblemFileName(SEARCH_FILE_NAME(name), format(GROUP_FORMAT, g), "bin");
 }
 
 const char* formatFileName(const char* name, FRAME_GROUP g, unsigned chunk)
 {
-	return formatProblemFileName(name, format(GROUP_FORMAT "-%u", g, chunk), "bin");
+	return formatProblemFileName(SEARCH_FILE_NAME(name), format(GROUP_FORMAT "-%u", g, chunk), "bin");
 }
 
 // ****************************************** Processing queue ******************************************
 
 #ifdef MULTITHREADING
 
-# define WORKERS (THREADS-1)
+# define WORKERS (threads-1)
+# define MAX_WORKERS (MAX_THREADS-1)
 # define PROCESS_QUEUE_SIZE 0x100000
 Node processQueue[PROCESS_QUEUE_SIZE]; // circular buffer
 size_t processQueueHead=0, processQueueTail=0;
@@ -1796,10 +2095,6 @@ CONDITION specialWorkersExitCondition;
 volatile int runningSpecialWorkers = 0;
 volatile bool stopSpecialWorkers = false;
 
-# ifdef USE_TRANSFORM_INVARIANT_SORTING
-
-# endif
-
 # ifdef ENABLE_EXPANSION_SPILLOVER
 void expansionReadSpilloverThread();
 # endif
@@ -1832,19 +2127,25 @@ bool dequeueState(Node* state)
 
 void doNothing() {}
 
-template<void (*STATE_HANDLER)(const Node*), void (*FINALIZATION_HANDLER)()>
+template<void (*STATE_HANDLER)(const Node*)>
+void processStates(const Node* nodes, int count)
+{
+	for (int i=0; i<count; i++)
+		STATE_HANDLER(&nodes[i]);
+}
+
+template<void (*BATCH_HANDLER)(const Node*, int), void (*FINALIZATION_HANDLER)()>
 void worker()
 {
 	Node cs[QUEUE_CHUNK_SIZE];
 	for (;;)
 	{
 		int n=0;
-		while (n<QUEUE_CHUNK_SIZE && dequeueState(&cs[n]))
+		while (n<(int)queueChunkSize && dequeueState(&cs[n]))
 			n++;
 		if (n == 0)
 			break;
-		for (int i=0; i<n; i++)
-			STATE_HANDLER(&cs[i]);
+		BATCH_HANDLER(cs, n);
 	}
 
 	FINALIZATION_HANDLER();
@@ -1857,8 +2158,9 @@ void worker()
 	}
 }
 
-template<void (*STATE_HANDLER)(const Node*), void (*FINALIZATION_HANDLER)()>
-void startWorkers()
+/// Starts workers which process dequeued nodes in chunks of up to queueChunkSize.
+template<void (*BATCH_HANDLER)(const Node*, int), void (*FINALIZATION_HANDLER)()>
+void startBatchWorkers()
 {
 # ifdef ENABLE_EXPANSION_SPILLOVER
 	{
@@ -1873,7 +2175,13 @@ void startWorkers()
 		runningWorkers += WORKERS;
 	}
 	for (THREAD_ID threadID=0; threadID<WORKERS; threadID++)
-		THREAD_CREATE<worker<STATE_HANDLER,FINALIZATION_HANDLER>>(threadID);
+		THREAD_CREATE<worker<BATCH_HANDLER,FINALIZATION_HANDLER>>(threadID);
+}
+
+template<void (*STATE_HANDLER)(const Node*), void (*FINALIZATION_HANDLER)()>
+void startWorkers()
+{
+	startBatchWorkers<&processStates<STATE_HANDLER>,FINALIZATION_HANDLER>();
 }
 
 void flushProcessingQueue()
@@ -1916,12 +2224,12 @@ BufferedOutputStream<Node> closedNodeFile;
 #ifdef ENABLE_EXPANSION_SPILLOVER
 bool expansionSpilloverLocked; // true if expansion spillover is currently being read or written to
 
-OutputStream<OpenNode> expansionSpilloverOut;
+OutputStream<ExpandedNode> expansionSpilloverOut;
 bool expansionSpilloverOutOpen;
 unsigned expansionSpilloverChunkOut;
 size_t   expansionSpilloverChunkOutPos;
 
-InputStream<OpenNode> expansionSpilloverIn;
+InputStream<ExpandedNode> expansionSpilloverIn;
 bool expansionSpilloverInOpen;
 unsigned expansionSpilloverChunkIn;
 size_t   expansionSpilloverChunkInPos;
@@ -1932,22 +2240,35 @@ size_t expansionSpilloverNodesQueued;
 
 #include "TimSort.cpp"
 
-#define EXPANSION_BUFFER_SLOTS (OPENNODE_BUFFER_SIZE / EXPANSION_NODES_PER_QUEUE_ELEMENT)
-#define EXPANSION_BUFFER_SIZE (EXPANSION_BUFFER_SLOTS * EXPANSION_NODES_PER_QUEUE_ELEMENT)
+#define EXPANSION_BUFFER_SLOTS (EXPANDEDNODE_BUFFER_SIZE / expansionNodesPerQueueElement)
+#define EXPANSION_BUFFER_SIZE (EXPANSION_BUFFER_SLOTS * expansionNodesPerQueueElement)
 
-const unsigned EXPANSION_BUFFER_FILL_THRESHOLD ((unsigned)(EXPANSION_BUFFER_SLOTS * EXPANSION_BUFFER_FILL_RATIO)  <=   EXPANSION_BUFFER_SLOTS - (WORKERS-1) ?
-                                                (unsigned)(EXPANSION_BUFFER_SLOTS * EXPANSION_BUFFER_FILL_RATIO)  >=   1                                    ?
-                                                (unsigned)(EXPANSION_BUFFER_SLOTS * EXPANSION_BUFFER_FILL_RATIO)     : 1
-                                                                                                                     : EXPANSION_BUFFER_SLOTS - (WORKERS-1));
+// These follow the runtime options, and are recomputed by setExpansionBufferLayout at the start of every Expanding step.
+BUFFER_INDEX EXPANSION_BUFFER_FILL_THRESHOLD;
 #ifdef ENABLE_EXPANSION_SPILLOVER
-const unsigned EXPANSION_SPILLOVER_WRITE_THRESHOLD  = EXPANSION_BUFFER_SLOTS - EXPANSION_BUFFER_FILL_THRESHOLD;
-const unsigned EXPANSION_SPILLOVER_READ_THRESHOLD   = EXPANSION_BUFFER_SLOTS - EXPANSION_BUFFER_FILL_THRESHOLD + 1;
+BUFFER_INDEX EXPANSION_SPILLOVER_WRITE_THRESHOLD;
+BUFFER_INDEX EXPANSION_SPILLOVER_READ_THRESHOLD;
 
-const unsigned EXPANSION_SPILLOVER_SLACK = (0x200000 + EXPANSION_NODES_PER_QUEUE_ELEMENT-1) / EXPANSION_NODES_PER_QUEUE_ELEMENT;
+unsigned EXPANSION_SPILLOVER_SLACK;
 #endif
 
-OpenNode* const EXPANSION_BUFFER     = (OpenNode*)ram;
-OpenNode* const EXPANSION_BUFFER_END = (OpenNode*)ram + EXPANSION_BUFFER_SIZE;
+ExpandedNode* EXPANSION_BUFFER;
+ExpandedNode* EXPANSION_BUFFER_END;
+
+void setExpansionBufferLayout()
+{
+	enforce(EXPANSION_BUFFER_SLOTS > WORKERS, "Not enough RAM for one expansion queue element per worker");
+	EXPANSION_BUFFER_FILL_THRESHOLD = (BUFFER_INDEX)(EXPANSION_BUFFER_SLOTS * EXPANSION_BUFFER_FILL_RATIO)  <=   EXPANSION_BUFFER_SLOTS - (WORKERS-1) ?
+	                                  (BUFFER_INDEX)(EXPANSION_BUFFER_SLOTS * EXPANSION_BUFFER_FILL_RATIO)  >=   1                                    ?
+	                                  (BUFFER_INDEX)(EXPANSION_BUFFER_SLOTS * EXPANSION_BUFFER_FILL_RATIO)     : 1
+	                                                                                                       : (BUFFER_INDEX)(EXPANSION_BUFFER_SLOTS - (WORKERS-1));
+#ifdef ENABLE_EXPANSION_SPILLOVER
+	EXPANSION_SPILLOVER_WRITE_THRESHOLD  = (BUFFER_INDEX)EXPANSION_BUFFER_SLOTS - EXPANSION_BUFFER_FILL_THRESHOLD;
+	EXPANSION_SPILLOVER_READ_THRESHOLD   = (BUFFER_INDEX)EXPANSION_BUFFER_SLOTS - EXPANSION_BUFFER_FILL_THRESHOLD + 1;
+
+	EXPANSION_SPILLOVER_SLACK = (0x200000 + expansionNodesPerQueueElement-1) / expansionNodesPerQueueElement;
+#endif
+}
 
 MUTEX expansionMutex;
 unsigned expansionChunks;
@@ -1957,7 +2278,7 @@ enum EXPANSION_BUFFER_REGION_TYPE
 	EXPANSION_BUFFER_REGION_FILLING,  // threadID==0
 //	EXPANSION_BUFFER_REGION_FILLING+1 is threadID==1
 //	EXPANSION_BUFFER_REGION_FILLING+2 is threadID==2, etc...
-	EXPANSION_BUFFER_REGION_FILLED = EXPANSION_BUFFER_REGION_FILLING + WORKERS,
+	EXPANSION_BUFFER_REGION_FILLED = EXPANSION_BUFFER_REGION_FILLING + MAX_WORKERS,
 	EXPANSION_BUFFER_REGION_READING,
 	EXPANSION_BUFFER_REGION_SORTING,
 	EXPANSION_BUFFER_REGION_WRITING,
@@ -1965,32 +2286,32 @@ enum EXPANSION_BUFFER_REGION_TYPE
 };
 struct ExpansionBufferRegion
 {
-	unsigned pos, length;
+	BUFFER_INDEX pos, length;
 	EXPANSION_BUFFER_REGION_TYPE type;
 };
 std::list<ExpansionBufferRegion> expansionBufferRegions;
-std::list<ExpansionBufferRegion>::iterator expansionThreadIter[WORKERS];
+std::list<ExpansionBufferRegion>::iterator expansionThreadIter[MAX_WORKERS];
 struct ExpansionBufferSortedRegion
 {
-	unsigned start, end;
+	BUFFER_INDEX start, end;
 };
-unsigned expansionBufferQueueNodesToMerge;
+BUFFER_INDEX expansionBufferQueueNodesToMerge;
 std::queue<ExpansionBufferSortedRegion> expansionBufferRegionsToMerge;
 //unsigned numSortsInProgress;
-volatile unsigned expansionChunkWriteInProgress[WORKERS];
-BufferedOutputStream<OpenNode> expansionWriteChunkThreadStream[WORKERS];
+volatile unsigned expansionChunkWriteInProgress[MAX_WORKERS];
+BufferedOutputStream<ExpandedNode> expansionWriteChunkThreadStream[MAX_WORKERS];
 #ifdef DEBUG_EXPANSION
 FILE *expansionDebug;
 #endif
 
 struct
 {
-	OpenNode* buffer;
-	int i;
+	ExpandedNode* buffer;
+	unsigned i;
 #ifdef ENABLE_EXPANSION_SPILLOVER
-	OpenNode* finalSortBufferEnd;
+	ExpandedNode* finalSortBufferEnd;
 #endif
-} expansionThread[WORKERS];
+} expansionThread[MAX_WORKERS];
 
 #ifdef DEBUG_EXPANSION
 void dumpExpansionDebug()
@@ -2007,7 +2328,7 @@ void dumpExpansionDebug()
 	{
 		debug_assert(!(i->type == EXPANSION_BUFFER_REGION_EMPTY && i->length==0));
 
-		for (unsigned x=0; x<i->length; x++)
+		for (BUFFER_INDEX x=0; x<i->length; x++)
 		{
 			switch (i->type)
 			{
@@ -2041,17 +2362,21 @@ void initExpansion()
 
 	//numSortsInProgress = 0;
 
+	setExpansionBufferLayout();
+	RamArenas arenas;
+	EXPANSION_BUFFER     = arenas.allocate<ExpandedNode>("expansion", EXPANSION_BUFFER_SIZE);
+	EXPANSION_BUFFER_END = EXPANSION_BUFFER + EXPANSION_BUFFER_SIZE;
 	expansionBufferRegions.clear();
 	expansionBufferQueueNodesToMerge = 0;
 	expansionBufferRegionsToMerge = std::queue<ExpansionBufferSortedRegion>();
-	OpenNode* slot = EXPANSION_BUFFER;
+	ExpandedNode* slot = EXPANSION_BUFFER;
 	for (THREAD_ID threadID=0; threadID<WORKERS; threadID++)
 	{
 		expansionChunkWriteInProgress[threadID] = false;
-		expansionWriteChunkThreadStream[threadID].setWriteBufferSize(64*1024*1024 / sizeof(OpenNode) / WORKERS);
+		expansionWriteChunkThreadStream[threadID].setWriteBufferSize(64*1024*1024 / sizeof(ExpandedNode) / WORKERS);
 
 		expansionThread[threadID].buffer = slot;
-		slot += EXPANSION_NODES_PER_QUEUE_ELEMENT;
+		slot += expansionNodesPerQueueElement;
 		expansionThread[threadID].i = 0;
 
 		ExpansionBufferRegion region;
@@ -2141,16 +2466,16 @@ void expansionRegionMarkEmpty(std::list<ExpansionBufferRegion>::iterator& region
 		regionToEmpty->type = EXPANSION_BUFFER_REGION_EMPTY;
 }
 
-//OutputStream<OpenNode> expansionWriteChunkThreadStream;
-OpenNode* expansionWriteChunkThreadBuffer[WORKERS];
-unsigned expansionWriteChunkThreadCount[WORKERS];
-std::list<ExpansionBufferRegion>::iterator expansionWriteChunkThreadRegion[WORKERS];
+//OutputStream<ExpandedNode> expansionWriteChunkThreadStream;
+ExpandedNode* expansionWriteChunkThreadBuffer[MAX_WORKERS];
+BUFFER_INDEX expansionWriteChunkThreadCount[MAX_WORKERS];
+std::list<ExpansionBufferRegion>::iterator expansionWriteChunkThreadRegion[MAX_WORKERS];
 void expansionWriteChunkThread()
 {
 	//expansionWriteChunkThreadStream.write(expansionWriteChunkThreadBuffer, expansionWriteChunkThreadCount);
 	//expansionWriteChunkThreadStream.close();
 	THREAD_ID threadID = TLS_GET_THREAD_ID;
-	mergeChunks<OpenNode, EXPANSION_NODES_PER_QUEUE_ELEMENT>(expansionWriteChunkThreadBuffer[threadID], expansionWriteChunkThreadCount[threadID], &expansionWriteChunkThreadStream[threadID]);
+	mergeChunks<ExpandedNode>(expansionWriteChunkThreadBuffer[threadID], expansionWriteChunkThreadCount[threadID], expansionNodesPerQueueElement, &expansionWriteChunkThreadStream[threadID]);
 	expansionWriteChunkThreadStream[threadID].close();
 
 	{
@@ -2185,8 +2510,8 @@ void sortExpansionRegion(std::list<ExpansionBufferRegion>::iterator& regionToSor
 	}
 
 	regionToSort->type = EXPANSION_BUFFER_REGION_SORTING;
-	OpenNode *bufferToSort = EXPANSION_BUFFER + regionToSort->pos * EXPANSION_NODES_PER_QUEUE_ELEMENT;
-	unsigned count = regionToSort->length * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+	ExpandedNode *bufferToSort = EXPANSION_BUFFER + regionToSort->pos * expansionNodesPerQueueElement;
+	BUFFER_INDEX count = regionToSort->length * expansionNodesPerQueueElement;
 	
 #ifdef DEBUG_EXPANSION
 	dumpExpansionDebug();
@@ -2270,7 +2595,7 @@ void sortExpansionSpilloverThread()
 	}
 }
 
-void expansionWriteSpillover(OpenNode *bufferToWrite, size_t count)
+void expansionWriteSpillover(ExpandedNode *bufferToWrite, size_t count)
 {
 	while (true)
 	{
@@ -2281,7 +2606,7 @@ void expansionWriteSpillover(OpenNode *bufferToWrite, size_t count)
 			expansionSpilloverOutOpen = true;
 		}
 
-		fpos_t spilloverToNextChunk = expansionSpilloverChunkOutPos + count - SPILLOVER_CHUNK_SIZE * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+		fpos_t spilloverToNextChunk = expansionSpilloverChunkOutPos + count - SPILLOVER_CHUNK_SIZE * expansionNodesPerQueueElement;
 		if (spilloverToNextChunk > 0)
 			count -= spilloverToNextChunk;
 
@@ -2304,7 +2629,7 @@ void expansionWriteSpillover(OpenNode *bufferToWrite, size_t count)
 	}
 }
 
-void expansionReadSpillover(OpenNode *bufferToRead, size_t count)
+void expansionReadSpillover(ExpandedNode *bufferToRead, size_t count)
 {
 	while (true)
 	{
@@ -2326,7 +2651,7 @@ void expansionReadSpillover(OpenNode *bufferToRead, size_t count)
 			expansionSpilloverInOpen = true;
 		}
 
-		fpos_t spilloverToNextChunk = expansionSpilloverChunkInPos + count - SPILLOVER_CHUNK_SIZE * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+		fpos_t spilloverToNextChunk = expansionSpilloverChunkInPos + count - SPILLOVER_CHUNK_SIZE * expansionNodesPerQueueElement;
 		if (spilloverToNextChunk > 0)
 			count -= spilloverToNextChunk;
 
@@ -2378,7 +2703,7 @@ void expansionReadSpillover(OpenNode *bufferToRead, size_t count)
 
 struct
 {
-	OpenNode *buffer;
+	ExpandedNode *buffer;
 	size_t    count;
 	std::list<ExpansionBufferRegion>::iterator region;
 } expansionSpilloverThreadBuffer[2];
@@ -2439,10 +2764,10 @@ void expansionReadSpilloverThread()
 			if (foundEmptyRegionToFill && firstEmptyRegionToFill->length >= EXPANSION_SPILLOVER_READ_THRESHOLD)
 			{
 				size_t expansionSpilloverPresented = expansionSpilloverNodesQueued;
-				if (expansionSpilloverPresented > EXPANSION_SPILLOVER_READ_THRESHOLD * EXPANSION_NODES_PER_QUEUE_ELEMENT)
-					expansionSpilloverPresented = EXPANSION_SPILLOVER_READ_THRESHOLD * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+				if (expansionSpilloverPresented > EXPANSION_SPILLOVER_READ_THRESHOLD * expansionNodesPerQueueElement)
+					expansionSpilloverPresented = EXPANSION_SPILLOVER_READ_THRESHOLD * expansionNodesPerQueueElement;
 
-				size_t count = firstEmptyRegionToFill->length * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+				size_t count = firstEmptyRegionToFill->length * expansionNodesPerQueueElement;
 				
 				if (count <= expansionSpilloverPresented)
 					firstEmptyRegionToFill->type = EXPANSION_BUFFER_REGION_READING;
@@ -2451,8 +2776,8 @@ void expansionReadSpilloverThread()
 					count = expansionSpilloverPresented;
 					ExpansionBufferRegion region;
 					region.pos = firstEmptyRegionToFill->pos;
-					assert(count % EXPANSION_NODES_PER_QUEUE_ELEMENT == 0);
-					region.length = (unsigned)(count / EXPANSION_NODES_PER_QUEUE_ELEMENT);
+					assert(count % expansionNodesPerQueueElement == 0);
+					region.length = (BUFFER_INDEX)(count / expansionNodesPerQueueElement);
 					region.type = EXPANSION_BUFFER_REGION_READING;
 					firstEmptyRegionToFill->pos    += region.length;
 					firstEmptyRegionToFill->length -= region.length;
@@ -2462,7 +2787,7 @@ void expansionReadSpilloverThread()
 				dumpExpansionDebug();
 	#endif
 
-				OpenNode *buffer = EXPANSION_BUFFER + firstEmptyRegionToFill->pos * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+				ExpandedNode *buffer = EXPANSION_BUFFER + firstEmptyRegionToFill->pos * expansionNodesPerQueueElement;
 
 				expansionSpilloverLocked = true;
 				lock.unlock();
@@ -2495,8 +2820,8 @@ void expansionHandleFilledQueueElement()
 
 	lock.unlock();
 	{
-		TimSort<OpenNode> sort;
-		sort.sort(expansionThread[threadID].buffer, EXPANSION_NODES_PER_QUEUE_ELEMENT);
+		TimSort<ExpandedNode> sort;
+		sort.sort(expansionThread[threadID].buffer, expansionNodesPerQueueElement);
 	}
 	lock.lock();
 
@@ -2511,10 +2836,10 @@ void expansionHandleFilledQueueElement()
 		bool lastRegionAdjacentToSortingBoundary = true;
 		bool regionToFillAdjacentToFilled = false;
 		bool lastRegionWasFilled = false;
-		unsigned totalEmptyLength = 0;
+		BUFFER_INDEX totalEmptyLength = 0;
 
 		std::list<ExpansionBufferRegion>::iterator longestFilledRegionToSort;
-		unsigned longestFilledLength = 0;
+		BUFFER_INDEX longestFilledLength = 0;
 		
 #ifdef ENABLE_EXPANSION_SPILLOVER
 		std::list<ExpansionBufferRegion>::iterator rightmostFilledRegionToSpillover;
@@ -2607,8 +2932,8 @@ void expansionHandleFilledQueueElement()
 					regionToWrite = expansionBufferRegions.insert(regionToWrite, region);
 			}
 
-			expansionSpilloverThreadBuffer[0].buffer = EXPANSION_BUFFER + regionToWrite->pos * EXPANSION_NODES_PER_QUEUE_ELEMENT;
-			expansionSpilloverThreadBuffer[0].count  = regionToWrite->length * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+			expansionSpilloverThreadBuffer[0].buffer = EXPANSION_BUFFER + regionToWrite->pos * expansionNodesPerQueueElement;
+			expansionSpilloverThreadBuffer[0].count  = regionToWrite->length * expansionNodesPerQueueElement;
 			expansionSpilloverThreadBuffer[0].region = regionToWrite;
 			expansionSpilloverThreadBuffer[1].buffer = NULL;
 
@@ -2637,8 +2962,8 @@ void expansionHandleFilledQueueElement()
 						secondRegionToWrite = expansionBufferRegions.insert(regionToWrite, region);
 				}
 
-				expansionSpilloverThreadBuffer[1].buffer = EXPANSION_BUFFER + secondRegionToWrite->pos * EXPANSION_NODES_PER_QUEUE_ELEMENT;
-				expansionSpilloverThreadBuffer[1].count  = secondRegionToWrite->length * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+				expansionSpilloverThreadBuffer[1].buffer = EXPANSION_BUFFER + secondRegionToWrite->pos * expansionNodesPerQueueElement;
+				expansionSpilloverThreadBuffer[1].count  = secondRegionToWrite->length * expansionNodesPerQueueElement;
 				expansionSpilloverThreadBuffer[1].region = secondRegionToWrite;
 			}
 
@@ -2676,7 +3001,7 @@ void expansionHandleFilledQueueElement()
 			expansionThread[threadID].i = 0;
 
 			debug_assert(expansionThread[threadID].buffer == NULL);
-			expansionThread[threadID].buffer = EXPANSION_BUFFER + region.pos * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+			expansionThread[threadID].buffer = EXPANSION_BUFFER + region.pos * expansionNodesPerQueueElement;
 	#ifdef DEBUG_EXPANSION
 			dumpExpansionDebug(threadID);
 	#endif
@@ -2695,24 +3020,176 @@ void expansionHandleFilledQueueElement()
 	}
 }
 
-#ifdef USE_TRANSFORM_INVARIANT_SORTING
-void writeOpenStateTransform(CompressedStateTransform transform, FRAME frame)
+#ifdef ESTIMATE_CARDINALITY
+
+#ifndef CARDINALITY_SKETCH_BITS
+# define CARDINALITY_SKETCH_BITS 12 // 4096 registers, for a standard error of about 1.6%
+#endif
+#define CARDINALITY_MARGIN 1.05 // preallocated sizes are padded by about three standard errors
+
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+INLINE unsigned leadingZeros64(uint64_t x) // x must not be 0
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(x >> 32)))
+		return 31 - index;
+	_BitScanReverse(&index, (unsigned long)x);
+	return 63 - index;
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
+/// FNV-1a over the state's bytes, followed by the MurmurHash3 finalizer to spread the bits.
+INLINE uint64_t sketchHash(const PackedCompressedState* cs)
+{
+	const uint8_t* p = (const uint8_t*)cs;
+	uint64_t h = 14695981039346656037ULL;
+	for (int i=0; i<COMPRESSED_BYTES; i++)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/// HyperLogLog sketch of a set of states: estimates the number of distinct states added to it, in constant space.
+struct CardinalitySketch
+{
+	enum { REGISTERS = 1 << CARDINALITY_SKETCH_BITS };
+	uint8_t registers[REGISTERS];
+
+	void clear()
+	{
+		memset(registers, 0, sizeof(registers));
+	}
+
+	INLINE void add(const PackedCompressedState* cs)
+	{
+		uint64_t hash = sketchHash(cs);
+		unsigned index = (unsigned)(hash >> (64 - CARDINALITY_SKETCH_BITS));
+		uint8_t rank = (uint8_t)(leadingZeros64((hash << CARDINALITY_SKETCH_BITS) | (1ULL << (CARDINALITY_SKETCH_BITS-1))) + 1);
+		if (registers[index] < rank)
+			registers[index] = rank;
+	}
+
+	void merge(const CardinalitySketch& other)
+	{
+		for (int i=0; i<REGISTERS; i++)
+			if (registers[i] < other.registers[i])
+				registers[i] = other.registers[i];
+	}
+
+	uint64_t estimate() const
+	{
+		double sum = 0;
+		int zeros = 0;
+		for (int i=0; i<REGISTERS; i++)
+		{
+			sum += ldexp(1.0, -registers[i]);
+			zeros += registers[i]==0;
+		}
+		double e = 0.7213 / (1 + 1.079 / REGISTERS) * REGISTERS * REGISTERS / sum;
+		if (e <= 2.5 * REGISTERS && zeros)
+			e = REGISTERS * log((double)REGISTERS / zeros); // linear counting is more accurate for small sets
+		return (uint64_t)(e + 0.5);
+	}
+};
+
+/// Per worker: the children generated during the Expanding step, and those of them in the next frame group.
+CardinalitySketch expansionSketches[MAX_WORKERS], expansionNextSketches[MAX_WORKERS];
+/// The closed nodes expanded in the last two frame groups, indexed by frame group parity.
+CardinalitySketch closedSketches[2];
+FRAME_GROUP closedSketchFrameGroups[2] = { -1, -1 };
+#ifdef BACKWARD_SEARCH
+const char* closedSketchPrefixes[2]; // the search side or stage (see searchFileNamePrefix) each sketch belongs to
+#endif
+
+/// Estimates made at the end of the Expanding step, if all of it ran in this process.
+struct
+{
+	bool valid;
+	uint64_t expanded;  // distinct expanded nodes, i.e. the output of the Merging step
+	uint64_t newNodes;  // expanded nodes which weren't closed in this or the previous frame group
+	uint64_t newClosed; // the same, only in the next frame group
+} cardinalityEstimate;
+
+void cardinalityStartExpanding()
+{
+	for (THREAD_ID threadID=0; threadID<WORKERS; threadID++)
+	{
+		expansionSketches[threadID].clear();
+		expansionNextSketches[threadID].clear();
+	}
+	int slot = currentFrameGroup & 1;
+	closedSketches[slot].clear();
+	closedSketchFrameGroups[slot] = currentFrameGroup;
+#ifdef BACKWARD_SEARCH
+	closedSketchPrefixes[slot] = searchFileNamePrefix;
+#endif
+}
+
+INLINE void cardinalityAddClosed(const Node* node)
 {
+	closedSketches[currentFrameGroup & 1].add(&node->state);
 }
+
+/// Merges the workers' sketches. Children which were closed in the current or the previous frame group (for problems with
+/// reversible unit-cost moves, that's all known children) are discounted by comparing the sketches with and without them.
+void cardinalityFinishExpanding()
+{
+	CardinalitySketch all = expansionSketches[0], next = expansionNextSketches[0];
+	for (THREAD_ID threadID=1; threadID<WORKERS; threadID++)
+	{
+		all.merge(expansionSketches[threadID]);
+		next.merge(expansionNextSketches[threadID]);
+	}
+
+	CardinalitySketch closed = closedSketches[currentFrameGroup & 1];
+	int previous = (currentFrameGroup-1) & 1;
+	bool havePrevious = closedSketchFrameGroups[previous] == currentFrameGroup-1;
+#ifdef BACKWARD_SEARCH
+	havePrevious = havePrevious && closedSketchPrefixes[previous] == searchFileNamePrefix;
 #endif
+	if (havePrevious)
+		closed.merge(closedSketches[previous]);
+	uint64_t closedCount = closed.estimate();
+
+	cardinalityEstimate.valid = true;
+	cardinalityEstimate.expanded = all.estimate();
+	all.merge(closed);
+	next.merge(closed);
+	uint64_t allCount = all.estimate(), nextCount = next.estimate();
+	cardinalityEstimate.newNodes  = min<uint64_t>(allCount  > closedCount ? allCount  - closedCount : 0, cardinalityEstimate.expanded);
+	cardinalityEstimate.newClosed = min<uint64_t>(nextCount > closedCount ? nextCount - closedCount : 0, cardinalityEstimate.newNodes);
+}
+
+#endif // ESTIMATE_CARDINALITY
 
 template<class NODE>
-void writeOpenState(const NODE* state, FRAME frame)
+void writeOpenState(const NODE* state, FRAME frame, uint8_t action)
 {
 	if (frame > MAX_FRAMES)
 		return;
 	FRAME_GROUP group = frame/FRAMES_PER_GROUP;
 	THREAD_ID threadID = TLS_GET_THREAD_ID;
+#ifdef ESTIMATE_CARDINALITY
+	expansionSketches[threadID].add((const PackedCompressedState*)state);
+	if (group == currentFrameGroup+1)
+		expansionNextSketches[threadID].add((const PackedCompressedState*)state);
+#endif
 
 	expansionThread[threadID].buffer[expansionThread[threadID].i].state = *state;
-	expansionThread[threadID].buffer[expansionThread[threadID].i].frame = (PACKED_FRAME)frame;
+	setFrame(&expansionThread[threadID].buffer[expansionThread[threadID].i], (PACKED_FRAME)frame);
+	SET_LAST_ACTION(expansionThread[threadID].buffer[expansionThread[threadID].i], action);
 	expansionThread[threadID].i++;
-	if (expansionThread[threadID].i == EXPANSION_NODES_PER_QUEUE_ELEMENT)
+	if (expansionThread[threadID].i == expansionNodesPerQueueElement)
 		expansionHandleFilledQueueElement();
 }
 
@@ -2721,15 +3198,15 @@ void expansionSortFinalRegions()
 	THREAD_ID threadID = TLS_GET_THREAD_ID;
 	if (expansionThread[threadID].buffer && expansionThread[threadID].i != 0)
 	{
-		TimSort<OpenNode> sort;
+		TimSort<ExpandedNode> sort;
 		sort.sort(expansionThread[threadID].buffer, expansionThread[threadID].i);
 
 		{
 			SCOPED_LOCK lock(expansionMutex);
 
 			ExpansionBufferSortedRegion region;
-			region.start = (unsigned)(expansionThread[threadID].buffer - EXPANSION_BUFFER);
-			region.end   = (unsigned)(expansionThread[threadID].buffer - EXPANSION_BUFFER) + expansionThread[threadID].i;
+			region.start = (BUFFER_INDEX)(expansionThread[threadID].buffer - EXPANSION_BUFFER);
+			region.end   = (BUFFER_INDEX)(expansionThread[threadID].buffer - EXPANSION_BUFFER) + expansionThread[threadID].i;
 			expansionBufferRegionsToMerge.push(region);
 			expansionBufferQueueNodesToMerge++;
 		}
@@ -2749,23 +3226,23 @@ void expansionMergeRegionsToDisk()
 #endif
 
 		ExpansionBufferSortedRegion region;
-		region.start =  i->pos              * EXPANSION_NODES_PER_QUEUE_ELEMENT;
-		region.end   = (i->pos + i->length) * EXPANSION_NODES_PER_QUEUE_ELEMENT;
+		region.start =  i->pos              * expansionNodesPerQueueElement;
+		region.end   = (i->pos + i->length) * expansionNodesPerQueueElement;
 		expansionBufferRegionsToMerge.push(region);
 		expansionBufferQueueNodesToMerge += i->length;
 	}
 
 	expansionBufferRegions.clear();
 
-	unsigned numInputs = 0;
+	BUFFER_INDEX numInputs = 0;
 	HeapNode *inputs = new HeapNode [expansionBufferQueueNodesToMerge];
 	while (!expansionBufferRegionsToMerge.empty())
 	{
 		std::queue<ExpansionBufferSortedRegion>::reference region = expansionBufferRegionsToMerge.front();
-		for (unsigned pos=region.start;;)
+		for (BUFFER_INDEX pos=region.start;;)
 		{
 			inputs[numInputs].pos = pos;
-			pos += EXPANSION_NODES_PER_QUEUE_ELEMENT;
+			pos += expansionNodesPerQueueElement;
 			if (pos >= region.end)
 			{
 				inputs[numInputs++].end = region.end;
@@ -2777,11 +3254,11 @@ void expansionMergeRegionsToDisk()
 	}
 	debug_assert(numInputs == expansionBufferQueueNodesToMerge);
 
-	BufferedOutputStream<OpenNode> output(64*1024*1024 / sizeof(OpenNode)); // allocate buffer outside of "ram"; reserve "ram" exclusively for expansion
+	BufferedOutputStream<ExpandedNode> output(64*1024*1024 / sizeof(ExpandedNode)); // allocate buffer outside of "ram"; reserve "ram" exclusively for expansion
 	output.open(formatFileName("expanded", currentFrameGroup, expansionChunks));
 	expansionChunks++;
 
-	mergeChunks<OpenNode, EXPANSION_NODES_PER_QUEUE_ELEMENT>(EXPANSION_BUFFER, inputs, numInputs, &output);
+	mergeChunks<ExpandedNode>(EXPANSION_BUFFER, inputs, numInputs, &output);
 }
 
 void expansionWriteFinalChunk()
@@ -2807,7 +3284,7 @@ void expansionWriteFinalChunk()
 
 	while (expansionSpilloverNodesQueued)
 	{
-		size_t count = OPENNODE_BUFFER_SIZE;
+		size_t count = EXPANDEDNODE_BUFFER_SIZE;
 		if (count > expansionSpilloverNodesQueued)
 			count = expansionSpilloverNodesQueued;
 # ifdef DEBUG_EXPANSION
@@ -2877,24 +3354,234 @@ void expansionWriteFinalChunk()
 #endif
 }
 
+#ifndef EXPANSION_CHECKPOINT_INTERVAL
+# define EXPANSION_CHECKPOINT_INTERVAL 0 // no checkpoints
+#endif
+
+/// Progress of the Expanding phase, saved every EXPANSION_CHECKPOINT_INTERVAL seconds: the nodes before "position" in the closed
+/// node file have been expanded, and their children have been written to the first "chunks" expanded chunks.
+struct ExpansionCheckpoint
+{
+	uint64_t position;
+	unsigned chunks;
+};
+
+void saveExpansionCheckpoint(const ExpansionCheckpoint* checkpoint, unsigned previousChunks)
+{
+#ifndef NO_DISK_FLUSH
+	// The chunks must be on disk before the checkpoint refers to them
+	for (unsigned i=previousChunks; i<checkpoint->chunks; i++)
+	{
+		OutputStream<ExpandedNode> chunk(formatFileName("expanded", currentFrameGroup, i), true);
+		chunk.flush();
+	}
+#endif
+	if (fileExists(formatFileName("expandingcheckpointnew", currentFrameGroup))) // left over from a crash before the rename
+		deleteFile(formatFileName("expandingcheckpointnew", currentFrameGroup));
+	{
+		OutputStream<ExpansionCheckpoint> output(formatFileName("expandingcheckpointnew", currentFrameGroup), false);
+		output.write(checkpoint, 1);
+		output.flush();
+	}
+	renameFile(formatFileName("expandingcheckpointnew", currentFrameGroup), formatFileName("expandingcheckpoint", currentFrameGroup), true);
+}
+
+/// Returns the last saved checkpoint of the current frame group's expansion (or the start), deleting any chunks written after it.
+ExpansionCheckpoint loadExpansionCheckpoint()
+{
+	ExpansionCheckpoint checkpoint = { 0, 0 };
+	if (fileExists(formatFileName("expandingcheckpoint", currentFrameGroup)))
+	{
+		InputStream<ExpansionCheckpoint> input(formatFileName("expandingcheckpoint", currentFrameGroup));
+		input.read(&checkpoint, 1);
+	}
+	for (unsigned i=checkpoint.chunks; fileExists(formatFileName("expanded", currentFrameGroup, i)); i++)
+		deleteFile(formatFileName("expanded", currentFrameGroup, i));
+#ifdef ENABLE_EXPANSION_SPILLOVER
+	for (unsigned i=0; fileExists(formatFileName("expansionSpillover", currentFrameGroup, i)); i++)
+		deleteFile(formatFileName("expansionSpillover", currentFrameGroup, i));
+#endif
+	return checkpoint;
+}
+
+/// Abandons the expansion of the current frame group, deleting the chunks written so far instead of merging them.
+/// Used once an exit has been found, as none of the expanded nodes will be needed.
+void expansionDiscard()
+{
+	for (THREAD_ID threadID=0; threadID<WORKERS; threadID++)
+		expansionWriteChunkThreadStream[threadID].deallocateBuffer();
+
+	for (unsigned i=0; i<expansionChunks; i++)
+		deleteFile(formatFileName("expanded", currentFrameGroup, i));
+	expansionChunks = 0;
+	if (fileExists(formatFileName("expandingcheckpoint", currentFrameGroup))) // it refers to the chunks deleted above
+		deleteFile(formatFileName("expandingcheckpoint", currentFrameGroup));
+
+#ifdef ENABLE_EXPANSION_SPILLOVER
+	if (expansionSpilloverOutOpen)
+		expansionSpilloverOut.close();
+	if (expansionSpilloverInOpen)
+		expansionSpilloverIn.close();
+	for (unsigned i=expansionSpilloverChunkIn; i<=expansionSpilloverChunkOut; i++)
+		if (fileExists(formatFileName("expansionSpillover", currentFrameGroup, i)))
+			deleteFile(formatFileName("expansionSpillover", currentFrameGroup, i));
+	expansionSpilloverNodesQueued = 0;
+#endif
+
+#ifdef DEBUG_EXPANSION
+	fclose(expansionDebug);
+#endif
+}
+
+#ifndef MERGE_CHECKPOINT_INTERVAL
+# define MERGE_CHECKPOINT_INTERVAL 0 // no checkpoints
+#endif
+
+/// Progress marker of the Merging or Combining phase. All nodes before "key" have been written to the outputs, which were flushed
+/// at the recorded sizes. The marker file also holds the position of the first unconsumed node of each input, which is checked
+/// against the key on resume (see seekMergeInputs).
+struct MergeCheckpoint
+{
+	OpenNode key;
+	uint64_t outputSizes[2];
+	uint64_t closedNodes, combinedNodes;
+};
+
+enum { MERGE_CHECKPOINT_WORDS = (sizeof(MergeCheckpoint) + sizeof(uint64_t)-1) / sizeof(uint64_t) };
+
+/// Reads the progress marker of an interrupted merge. Returns false if there is none.
+bool loadMergeCheckpoint(const char* filename, MergeCheckpoint* checkpoint, uint64_t inputPositions[], int inputCount)
+{
+	if (!fileExists(filename))
+		return false;
+	InputStream<uint64_t> input(filename);
+	if (input.size() != (uint64_t)(MERGE_CHECKPOINT_WORDS + inputCount))
+		error(format("Progress marker %s does not match the merge inputs", filename));
+	uint64_t* words = new uint64_t[MERGE_CHECKPOINT_WORDS + inputCount];
+	input.read(words, MERGE_CHECKPOINT_WORDS + inputCount);
+	memcpy(checkpoint, words, sizeof(MergeCheckpoint));
+	memcpy(inputPositions, words + MERGE_CHECKPOINT_WORDS, inputCount * sizeof(uint64_t));
+	delete[] words;
+	return true;
+}
+
+/// Seeks the inputs of an interrupted merge to their recorded positions, and checks them against the marker key:
+/// no input may continue before the key, and one of them must continue at the key itself.
+template<class NODE, class INPUT>
+void seekMergeInputs(const char* filename, const MergeCheckpoint& checkpoint, INPUT inputs[], const uint64_t inputPositions[], int inputCount)
+{
+	NODE key;
+	memset(&key, 0, sizeof(key));
+	key.state = checkpoint.key.state;
+	bool atKey = false;
+	for (int i=0; i<inputCount; i++)
+	{
+		inputs[i].seek(inputPositions[i]);
+		const NODE* head = inputs[i].read();
+		if (head == NULL)
+			continue;
+		enforce(!(*head < key), format("Progress marker %s does not match the merge inputs", filename));
+		if (*head == key && getFrame(head) == getFrame(&checkpoint.key))
+			atKey = true;
+		inputs[i].rewind();
+	}
+	enforce(atKey, format("Progress marker %s does not match the merge inputs", filename));
+}
+
+/// Passed to mergeStreams to save a progress marker every MERGE_CHECKPOINT_INTERVAL seconds, which loadMergeCheckpoint reads
+/// to resume the merge. OUTPUT2 is the closed node file when Combining.
+template<class OUTPUT1, class OUTPUT2=OUTPUT1>
+class MergeProgress
+{
+	const char* name;
+	OUTPUT1* output1;
+	OUTPUT2* output2;
+	unsigned calls;
+	time_t checkpointTime;
+
+public:
+	MergeProgress(const char* name, OUTPUT1* output1, OUTPUT2* output2=NULL) : name(name), output1(output1), output2(output2), calls(0)
+	{
+		checkpointTime = time(NULL) + MERGE_CHECKPOINT_INTERVAL;
+	}
+
+	INLINE bool due()
+	{
+		return MERGE_CHECKPOINT_INTERVAL && (++calls & 0xFFFF) == 0 && time(NULL) >= checkpointTime;
+	}
+
+	template<class NODE, class INPUT>
+	void save(const NODE* key, INPUT inputs[], int inputCount)
+	{
+		MergeCheckpoint checkpoint;
+		memset(&checkpoint, 0, sizeof(checkpoint));
+		checkpoint.key.state = key->state;
+		checkpoint.key.frame = getFrame(key);
+		output1->flush();
+		checkpoint.outputSizes[0] = output1->position();
+		if (output2)
+		{
+			output2->flush();
+			checkpoint.outputSizes[1] = output2->position();
+		}
+		checkpoint.closedNodes   = closedNodesInCurrentFrameGroup;
+		checkpoint.combinedNodes = combinedNodesTotal;
+
+		uint64_t* words = new uint64_t[MERGE_CHECKPOINT_WORDS + inputCount];
+		memset(words, 0, MERGE_CHECKPOINT_WORDS * sizeof(uint64_t));
+		memcpy(words, &checkpoint, sizeof(MergeCheckpoint));
+		for (int i=0; i<inputCount; i++)
+			words[MERGE_CHECKPOINT_WORDS + i] = inputs[i].headPosition();
+		if (fileExists(formatFileName(format("%snew", name), currentFrameGroup))) // left over from a crash before the rename
+			deleteFile(formatFileName(format("%snew", name), currentFrameGroup));
+		{
+			OutputStream<uint64_t> output(formatFileName(format("%snew", name), currentFrameGroup), false);
+			output.write(words, MERGE_CHECKPOINT_WORDS + inputCount);
+			output.flush();
+		}
+		delete[] words;
+		renameFile(formatFileName(format("%snew", name), currentFrameGroup), formatFileName(name, currentFrameGroup), true);
+		checkpointTime = time(NULL) + MERGE_CHECKPOINT_INTERVAL;
+	}
+};
+
+/// The cost of a buffer refill of the Merging output, relative to that of one of its inputs, as measured during the last Merging step.
+double mergeOutputCostRatio = 1;
+
 void mergeExpanded()
 {
 	if (expansionChunks>1)
 	{
-		BufferedOutputStream<OpenNode>* output = new BufferedOutputStream<OpenNode>;
-		BufferedInputStream<OpenNode>* inputs = new BufferedInputStream<OpenNode>[expansionChunks];
+		BufferedOutputStream<ExpandedNode>* output = new BufferedOutputStream<ExpandedNode>;
+		BufferedInputStream<ExpandedNode>* inputs = new BufferedInputStream<ExpandedNode>[expansionChunks];
 		
-		double outbuf_inbuf_ratio = sqrt(EXPECTED_MERGING_RATIO * expansionChunks);
-		uint32_t bufferSize = (uint32_t)floor(OPENNODE_BUFFER_SIZE / (expansionChunks + outbuf_inbuf_ratio));
+		double mergingRatio = EXPECTED_MERGING_RATIO;
+#ifdef ESTIMATE_CARDINALITY
+		if (cardinalityEstimate.valid)
+		{
+			uint64_t inputNodes = 0;
+			for (unsigned i=0; i<expansionChunks; i++)
+			{
+				InputStream<ExpandedNode> getSize(formatFileName("expanded", currentFrameGroup, i));
+				inputNodes += getSize.size();
+			}
+			if (inputNodes)
+				mergingRatio = min(1.0, (double)cardinalityEstimate.expanded / inputNodes);
+		}
+#endif
+		// The same square root rule as in ramPlannerUpdate, with all inputs sharing one size
+		double outbuf_inbuf_ratio = sqrt(mergingRatio * expansionChunks * mergeOutputCostRatio);
+		BUFFER_INDEX bufferSize = (BUFFER_INDEX)floor(EXPANDEDNODE_BUFFER_SIZE / (expansionChunks + outbuf_inbuf_ratio));
 		
-		if (expansionChunks <= OPENNODE_BUFFER_SIZE && bufferSize && (expansionChunks+1)*bufferSize <= OPENNODE_BUFFER_SIZE)
+		RamArenas arenas;
+		if (expansionChunks <= EXPANDEDNODE_BUFFER_SIZE && bufferSize && (expansionChunks+1)*bufferSize <= EXPANDEDNODE_BUFFER_SIZE)
 		{
-			output->setWriteBuffer((OpenNode*)ram + expansionChunks*bufferSize, (uint32_t)OPENNODE_BUFFER_SIZE - expansionChunks*bufferSize);
 			for (unsigned i=0; i<expansionChunks; i++)
-				inputs[i].setReadBuffer((OpenNode*)ram + i*bufferSize, (uint32_t)bufferSize);
+				inputs[i].setReadBuffer(arenas.allocate<ExpandedNode>("merging inputs", bufferSize), (BUFFER_INDEX)bufferSize);
+			output->setWriteBuffer(arenas.allocate<ExpandedNode>("merging output", EXPANDEDNODE_BUFFER_SIZE - expansionChunks*bufferSize), (BUFFER_INDEX)EXPANDEDNODE_BUFFER_SIZE - expansionChunks*bufferSize);
 		}
 		else
-			output->setWriteBuffer((OpenNode*)ram, (uint32_t)OPENNODE_BUFFER_SIZE);
+			output->setWriteBuffer(arenas.allocate<ExpandedNode>("merging output", EXPANDEDNODE_BUFFER_SIZE), (BUFFER_INDEX)EXPANDEDNODE_BUFFER_SIZE);
 
 #ifdef PREALLOCATE_COMBINING
 		uint64_t size = 0;
@@ -2907,18 +3594,51 @@ void mergeExpanded()
 #endif
 		}
 		
-		output->open(formatFileName("merging", currentFrameGroup));
+		MergeCheckpoint checkpoint;
+		uint64_t* inputPositions = new uint64_t[expansionChunks];
+		if (loadMergeCheckpoint(formatFileName("mergingprogress", currentFrameGroup), &checkpoint, inputPositions, expansionChunks))
+		{
+			printf(" (Resuming after %llu nodes)", (unsigned long long)checkpoint.outputSizes[0]); fflush(stdout);
+			truncateFile(formatFileName("merging", currentFrameGroup), checkpoint.outputSizes[0] * sizeof(ExpandedNode));
+			output->open(formatFileName("merging", currentFrameGroup), true);
+			seekMergeInputs<ExpandedNode>(formatFileName("mergingprogress", currentFrameGroup), checkpoint, inputs, inputPositions, expansionChunks);
+		}
+		else
+		{
+			if (fileExists(formatFileName("merging", currentFrameGroup)))
+				deleteFile(formatFileName("merging", currentFrameGroup));
+			output->open(formatFileName("merging", currentFrameGroup));
 #ifdef PREALLOCATE_COMBINING
-		// We could multiply this by EXPECTED_MERGING_RATIO, but there's no point really, as nothing else is consuming space during this step
-		size = (size * sizeof(OpenNode) + 0x1FF) & -0x200;
-		output->preallocate(size);
+			// We could multiply this by EXPECTED_MERGING_RATIO, but there's no point really, as nothing else is consuming space during this step
+#ifdef ESTIMATE_CARDINALITY
+			if (cardinalityEstimate.valid)
+				size = min<uint64_t>(size, (uint64_t)(cardinalityEstimate.expanded * CARDINALITY_MARGIN));
 #endif
+			size = (size * sizeof(ExpandedNode) + 0x1FF) & -0x200;
+			output->preallocate(size);
+#endif
+		}
+		delete[] inputPositions;
 
-		mergeStreams<OpenNode>(inputs, expansionChunks, output);
+		MergeProgress<BufferedOutputStream<ExpandedNode> > progress("mergingprogress", output);
+		mergeStreams<ExpandedNode>(inputs, expansionChunks, output, &progress);
+		output->flushBuffer();
+
+		IOStats in;
+		for (unsigned i=0; i<expansionChunks; i++)
+		{
+			in.transfers    += inputs[i].ioStats().transfers;
+			in.microseconds += inputs[i].ioStats().microseconds;
+		}
+		const IOStats& out = output->ioStats();
+		if (in.transfers && out.transfers && in.microseconds && out.microseconds)
+			mergeOutputCostRatio = (mergeOutputCostRatio + ((double)out.microseconds / out.transfers) / ((double)in.microseconds / in.transfers)) / 2;
 		
 		delete[] inputs;
 		delete output;
 
+		if (fileExists(formatFileName("mergingprogress", currentFrameGroup)))
+			deleteFile(formatFileName("mergingprogress", currentFrameGroup));
 		renameFile(formatFileName("merging", currentFrameGroup), formatFileName("expanded", currentFrameGroup));
 #ifndef KEEP_PAST_FILES
 		for (unsigned i=0; i<expansionChunks; i++)
@@ -2929,7 +3649,7 @@ void mergeExpanded()
 	if (expansionChunks)
 		renameFile(formatFileName("expanded", currentFrameGroup, 0), formatFileName("expanded", currentFrameGroup));
 	else
-		OutputStream<OpenNode> output(formatFileName("expanded", currentFrameGroup), false); // create zero byte file
+		OutputStream<ExpandedNode> output(formatFileName("expanded", currentFrameGroup), false); // create zero byte file
 
 	expansionChunks = 0;
 }
@@ -2970,17 +3690,10 @@ INLINE uint32_t hashState(const CompressedState* state)
 }
 #endif
 
-void addState(const CompressedState* cs, FRAME frame)
-{
-	writeOpenState(cs, frame);
-}
-
-#ifdef USE_TRANSFORM_INVARIANT_SORTING
-void addStateTransform(CompressedStateTransform transform, FRAME frame)
+void addState(const CompressedState* cs, FRAME frame, uint8_t action)
 {
-	writeOpenStateTransform(transform, frame);
+	writeOpenState(cs, frame, action);
 }
-#endif
 
 // ******************************************** Exit tracing ********************************************
 
@@ -2988,7 +3701,10 @@ CompressedState exitSearchCompressedState;
 State exitSearchState     , exitSearchStateParent     ;
 FRAME exitSearchStateFrame, exitSearchStateParentFrame;
 Step exitSearchStateStep;
-bool exitSearchStateFound = false;
+volatile bool exitSearchStateFound = false;
+#ifdef TRACE_LAST_ACTION
+uint8_t exitSearchStateAction, exitSearchStateParentAction; // NO_LAST_ACTION if not known
+#endif
 int exitSearchFrameGroup; // allow negative
 #ifdef MULTITHREADING
 MUTEX exitSearchStateMutex;
@@ -3002,23 +3718,28 @@ class FinishCheckChildHandler
 public:
 	enum { PREFERRED = PREFERRED_STATE_NEITHER };
 
-#ifdef USE_TRANSFORM_INVARIANT_SORTING
-	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, CompressedStateTransform transform, FRAME frame)
-	{
-		/* no need to do anything, since this will never be called for FinishCheckChildHandler */
-	}
-#endif
-
 	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const State* state, FRAME frame)
 	{
-		if (*state==exitSearchState && frame==exitSearchStateFrame)
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+		State canonicalState = *state;
+		canonicalState.canonicalize();
+		if (canonicalState==exitSearchState && frame==exitSearchStateFrame)
+#else
+		if (*state==exitSearchState && frame==exitSearchStateFrame)
+#endif
 			found(step, parent, parentFrame);
 	}
 
 	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const CompressedState* state, FRAME frame)
 	{
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+		State uncompressedState;
+		uncompressedState.decompress(state);
+		handleChild(parent, parentFrame, step, &uncompressedState, frame);
+#else
 		if (*state==exitSearchCompressedState && frame==exitSearchStateFrame)
 			found(step, parent, parentFrame);
+#endif
 	}
 
 	static void found(Step step, const State* parent, FRAME parentFrame)
@@ -3033,12 +3754,18 @@ public:
 	}
 };
 
+template<bool BACKWARD>
 INLINE void processExitState(const Node* cs)
 {
 	State state;
 	state.decompress(&cs->getState());
 	FRAME frame = GET_FRAME(exitSearchFrameGroup, *cs);
-	expandChildren<FinishCheckChildHandler>(frame, &state);
+#ifdef BACKWARD_SEARCH
+	if (BACKWARD)
+		expandParents<FinishCheckChildHandler>(frame, &state);
+	else
+#endif
+		expandChildren<FinishCheckChildHandler>(frame, &state);
 
 #ifdef DEBUG
 # ifdef MULTITHREADING
@@ -3049,6 +3776,13 @@ INLINE void processExitState(const Node* cs)
 #endif
 }
 
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+// Closed node files hold only canonical states, so a traced step leads from a canonical state to some transformation of the next one.
+// The canonical state and frame after each step are kept, so that the actual steps can be found again by untransformSteps.
+State exitTraceStates[MAX_STEPS];
+FRAME exitTraceFrames[MAX_STEPS];
+#endif
+
 void saveExitTrace(Step *steps, int stepNr)
 {
 	FILE* f = fopen(formatFileName("solution"), "wb");
@@ -3057,23 +3791,299 @@ void saveExitTrace(Step *steps, int stepNr)
 	fwrite(&exitSearchState     , sizeof(exitSearchState)     , 1, f);
 	fwrite(&stepNr              , sizeof(stepNr)              , 1, f);
 	fwrite(steps, sizeof(Step), stepNr, f);
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+	fwrite(exitTraceStates, sizeof(State), stepNr, f);
+	fwrite(exitTraceFrames, sizeof(FRAME), stepNr, f);
+#endif
+#ifdef TRACE_LAST_ACTION
+	fwrite(&exitSearchStateAction, sizeof(exitSearchStateAction), 1, f);
+#endif
+	fclose(f);
+}
+
+void loadExitTrace(Step *steps, int* stepNr)
+{
+	FILE* f = fopen(formatFileName("solution"), "rb");
+	fread(&exitSearchFrameGroup, sizeof(exitSearchFrameGroup), 1, f);
+	fread(&exitSearchStateFrame, sizeof(exitSearchStateFrame), 1, f);
+	fread(&exitSearchState     , sizeof(exitSearchState)     , 1, f);
+	fread( stepNr              , sizeof(*stepNr)             , 1, f);
+	fread(steps, sizeof(Step), *stepNr, f);
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+	fread(exitTraceStates, sizeof(State), *stepNr, f);
+	fread(exitTraceFrames, sizeof(FRAME), *stepNr, f);
+#endif
+#ifdef TRACE_LAST_ACTION
+	fread(&exitSearchStateAction, sizeof(exitSearchStateAction), 1, f);
+#endif
 	fclose(f);
 }
 
-void traceExit(const State* exitState, FRAME exitFrame)
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+State untransformTargetState, untransformChildState;
+FRAME untransformTargetFrame;
+Step untransformStep;
+bool untransformFound;
+
+class UntransformChildHandler
+{
+public:
+	enum { PREFERRED = PREFERRED_STATE_UNCOMPRESSED };
+
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const State* state, FRAME frame)
+	{
+		State canonicalState = *state;
+		canonicalState.canonicalize();
+		if (!untransformFound && canonicalState==untransformTargetState && frame==untransformTargetFrame)
+		{
+			untransformFound      = true;
+			untransformStep       = step;
+			untransformChildState = *state;
+		}
+	}
+
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const CompressedState* state, FRAME frame)
+	{
+		State uncompressedState;
+		uncompressedState.decompress(state);
+		handleChild(parent, parentFrame, step, &uncompressedState, frame);
+	}
+};
+
+/// Replaces the traced steps (which were found from canonical states) with the steps leading through the actual states,
+/// starting from *state at the given frame. If *state is the canonical form of an initial state, it is replaced with that initial state.
+void untransformSteps(State* state, FRAME frame, Step steps[], int stepNr)
+{
+	for (int i=0; i<initialStateCount; i++)
+	{
+		State canonicalState = initialStates[i];
+		canonicalState.canonicalize();
+		if (canonicalState == *state)
+		{
+			*state = initialStates[i];
+			break;
+		}
+	}
+
+	State current = *state;
+	for (int i=stepNr-1; i>=0; i--)
+	{
+		untransformTargetState = exitTraceStates[i];
+		untransformTargetFrame = exitTraceFrames[i];
+		untransformFound = false;
+		expandChildren<UntransformChildHandler>(frame, &current);
+		if (!untransformFound)
+			error("Can't find the untransformed step!");
+		steps[i] = untransformStep;
+		current  = untransformChildState;
+		frame    = untransformTargetFrame;
+	}
+}
+#endif
+
+/// Returns false if, according to the problem traits, a node at this frame can't be the parent of exitSearchState/exitSearchStateFrame.
+INLINE bool canBeExitParentFrame(FRAME frame)
+{
+	if (ProblemTraits::unitCost)
+		return frame == exitSearchStateFrame - 1;
+	if (ProblemTraits::maxFrameDelay)
+		return frame < exitSearchStateFrame && frame >= exitSearchStateFrame - ProblemTraits::maxFrameDelay;
+	return true;
+}
+
+/// Looks up a state in a sorted node file, by binary search until the remaining range fits in a small window, which is then read at once.
+/// Returns false if the state isn't in the file.
+template<class NODE>
+bool findNodeInFile(InputStream<NODE>* input, uint64_t size, const CompressedState* state, NODE* result)
+{
+	enum { WINDOW = 4096 / sizeof(NODE) + 1 };
+	NODE window[WINDOW];
+	uint64_t lo = 0, hi = size; // the state can only be in [lo, hi)
+	while (hi - lo > WINDOW)
+	{
+		uint64_t mid = lo + (hi - lo) / 2;
+		input->seek(mid);
+		if (input->read(window, 1) != 1)
+			error("Unexpected end of file");
+		if (*state < window[0].getState())
+			hi = mid;
+		else
+		if (*state > window[0].getState())
+			lo = mid + 1;
+		else
+		{
+			*result = window[0];
+			return true;
+		}
+	}
+	if (lo == hi)
+		return false;
+	input->seek(lo);
+	size_t n = (size_t)(hi - lo);
+	if (input->read(window, n) != n)
+		error("Unexpected end of file");
+	NODE key;
+	key.state = state;
+	NODE* p = std::lower_bound(window, window+n, key);
+	if (p == window+n || *p != key)
+		return false;
+	*result = *p;
+	return true;
+}
+
+InputStream<Node>* exitLookupInput;
+uint64_t exitLookupSize;
+
+/// Receives the parent candidates of exitSearchState (from expandParents, or expandChildren when tracing backward), and looks up the ones
+/// which belong to frame group exitSearchFrameGroup in its closed node file. The candidates are enumerated from frame 0,
+/// so that the frame passed to handleChild is the step's frame delay.
+class ExitCandidateHandler
+{
+public:
+	enum { PREFERRED = PREFERRED_STATE_UNCOMPRESSED };
+
+	static INLINE void handleChild(const State* state, FRAME zero, Step step, const State* candidate, FRAME delay)
+	{
+		FRAME frame = exitSearchStateFrame - delay;
+		if (exitSearchStateFound || frame < 0 || frame / FRAMES_PER_GROUP != exitSearchFrameGroup)
+			return;
+#ifdef TRACE_LAST_ACTION
+		// The state's node tells which step created it, so only that step's candidate needs to be looked up.
+		if (exitSearchStateAction != NO_LAST_ACTION && getStepAction(step) != exitSearchStateAction)
+			return;
+#endif
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+		State canonicalState = *candidate;
+		canonicalState.canonicalize();
+		candidate = &canonicalState;
+#endif
+		CompressedState cs;
+		candidate->compress(&cs);
+		Node node;
+		if (findNodeInFile(exitLookupInput, exitLookupSize, &cs, &node) && GET_FRAME(exitSearchFrameGroup, node) == frame)
+		{
+			FinishCheckChildHandler::found(step, candidate, frame);
+#ifdef TRACE_LAST_ACTION
+			exitSearchStateParentAction = node.lastAction;
+#endif
+		}
+	}
+
+	static INLINE void handleChild(const State* state, FRAME zero, Step step, const CompressedState* cs, FRAME delay)
+	{
+		State candidate;
+		candidate.decompress(cs);
+		handleChild(state, zero, step, &candidate, delay);
+	}
+};
+
+/// Looks for the parent of exitSearchState with a few random reads of closed node file exitSearchFrameGroup,
+/// instead of expanding all the states in it.
+template<bool BACKWARD>
+void lookupExitParent()
+{
+	InputStream<Node> input(formatFileName("closed", exitSearchFrameGroup));
+	exitLookupInput = &input;
+	exitLookupSize = input.size();
+#ifdef HAVE_EXPAND_PARENTS
+	if (!BACKWARD)
+		expandParents<ExitCandidateHandler>(0, &exitSearchState);
+	else
+#endif
+		expandChildren<ExitCandidateHandler>(0, &exitSearchState);
+	exitLookupInput = NULL;
+}
+
+/// Processes the candidate parents of exitSearchState read from the input, stopping early once the parent was found (by any thread).
+template<bool BACKWARD, class INPUT>
+void scanForExitParent(INPUT* input)
+{
+	const Node *cs;
+	while (!exitSearchStateFound && (cs = input->read()))
+		if (canBeExitParentFrame(GET_FRAME(exitSearchFrameGroup, *cs)) &&
+		    (BACKWARD ? canStatesBeParentAndChild(&exitSearchCompressedState, &cs->getState())
+		              : canStatesBeParentAndChild(&cs->getState(), &exitSearchCompressedState)))
+		{
+#ifndef MULTITHREADING
+			DEBUG_ONLY(statesQueued++);
+#endif
+			processExitState<BACKWARD>(cs);
+		}
+}
+
+#ifdef MULTITHREADING
+uint64_t exitSearchNodeCount;
+
+/// Scans this worker's share of the closed node file exitSearchFrameGroup.
+template<bool BACKWARD>
+void exitSearchRangeWorker()
+{
+	THREAD_ID threadID = TLS_GET_THREAD_ID;
+	{
+		BufferedSplitInputStream<Node> input(formatFileName("closed", exitSearchFrameGroup),
+			exitSearchNodeCount *  threadID    / WORKERS,
+			exitSearchNodeCount * (threadID+1) / WORKERS);
+		scanForExitParent<BACKWARD>(&input);
+	}
+
+	SCOPED_LOCK lock(processQueueMutex);
+	runningWorkers--;
+	CONDITION_NOTIFY(processQueueExitCondition, lock);
+}
+#endif
+
+/// Looks for the parent of exitSearchState/exitSearchStateFrame among the nodes in closed node file exitSearchFrameGroup.
+/// When tracing the backward search of a bidirectional search, the "parent" is the state that exitSearchState leads to.
+template<bool BACKWARD>
+bool findExitParent()
+{
+	exitSearchState.compress(&exitSearchCompressedState);
+	exitSearchStateFound = false;
+
+#ifndef HAVE_EXPAND_PARENTS
+	if (BACKWARD) // the parents of the backward search are the children of the state
+#endif
+	{
+		lookupExitParent<BACKWARD>();
+		return exitSearchStateFound;
+	}
+
+#ifdef MULTITHREADING
+	// Every worker reads and expands its own range of the file, so reading isn't limited to a single thread.
+	{
+		InputStream<Node> getSize(formatFileName("closed", exitSearchFrameGroup));
+		exitSearchNodeCount = getSize.size();
+	}
+	{
+		SCOPED_LOCK lock(processQueueMutex);
+		runningWorkers += WORKERS;
+	}
+	for (THREAD_ID threadID=0; threadID<WORKERS; threadID++)
+		THREAD_CREATE<exitSearchRangeWorker<BACKWARD>>(threadID);
+	flushProcessingQueue();
+#else
+	DEBUG_ONLY(statesQueued = statesDequeued = 0);
+	BufferedInputStream<Node> input(formatFileName("closed", exitSearchFrameGroup));
+	scanForExitParent<BACKWARD>(&input);
+	debug_assert(statesQueued == statesDequeued, format("Queued %d states but dequeued only %d!", statesQueued, statesDequeued));
+#endif
+
+	return exitSearchStateFound;
+}
+
+/// tailSteps/tailStepCount are the steps (in the order they are to be performed) from exitState to the finish,
+/// for when exitState is not a finish state itself (see bidirectionalSearch).
+void traceExit(const State* exitState, FRAME exitFrame, const Step* tailSteps=NULL, int tailStepCount=0)
 {
 	Step steps[MAX_STEPS];
 	int stepNr = 0;
+#ifdef TRACE_LAST_ACTION
+	exitSearchStateAction = NO_LAST_ACTION;
+#endif
 	
 	if (fileExists(formatFileName("solution")))
 	{
-		FILE* f = fopen(formatFileName("solution"), "rb");
-		fread(&exitSearchFrameGroup, sizeof(exitSearchFrameGroup), 1, f);
-		fread(&exitSearchStateFrame, sizeof(exitSearchStateFrame), 1, f);
-		fread(&exitSearchState     , sizeof(exitSearchState)     , 1, f);
-		fread(&stepNr              , sizeof(stepNr)              , 1, f);
-		fread(steps, sizeof(Step), stepNr, f);
-		fclose(f);
+		loadExitTrace(steps, &stepNr);
 
 		if (exitSearchFrameGroup >= 0)
 		{
@@ -3092,6 +4102,8 @@ void traceExit(const State* exitState, FRAME exitFrame)
 		exitSearchState      = *exitState;
 		exitSearchStateFrame =  exitFrame;
 		exitSearchFrameGroup =  exitFrame / FRAMES_PER_GROUP;
+		while (tailStepCount)
+			steps[stepNr++] = tailSteps[--tailStepCount];
 	}
 	else
 		error("Can't resume exit tracing - partial trace solution file not found");
@@ -3103,6 +4115,9 @@ void traceExit(const State* exitState, FRAME exitFrame)
 		if (exitSearchFrameGroup < 0)
 			goto found;
 
+		if (ProblemTraits::maxFrameDelay && (exitSearchFrameGroup+1) * FRAMES_PER_GROUP <= exitSearchStateFrame - ProblemTraits::maxFrameDelay)
+			break; // all remaining frame groups are too far back to hold the parent
+
 		if (fileExists(formatFileName("closed", exitSearchFrameGroup)))
 		{
 			saveExitTrace(steps, stepNr);
@@ -3110,42 +4125,19 @@ void traceExit(const State* exitState, FRAME exitFrame)
 			printTime();
 			printf("Frame" GROUP_STR " " GROUP_FORMAT "... \n", exitSearchFrameGroup);
 
-			exitSearchState.compress(&exitSearchCompressedState);
-			exitSearchStateFound = false;
-				
-#ifdef MULTITHREADING
-			startWorkers<&processExitState,&doNothing>();
-#endif
-
-			BufferedInputStream<Node> input(formatFileName("closed", exitSearchFrameGroup));
-			const Node *cs;
-			DEBUG_ONLY(statesQueued = statesDequeued = 0);
-			while (cs = input.read())
-			{
-				DEBUG_ONLY(statesQueued++);
-				if (canStatesBeParentAndChild(&cs->getState(), &exitSearchCompressedState))
-				{
-#ifdef MULTITHREADING
-					queueState(cs);
-#else
-					processExitState(cs);
-#endif
-				}
-				if (exitSearchStateFound)
-					break;
-			}
-			
-#ifdef MULTITHREADING
-			flushProcessingQueue();
-#endif
-			debug_assert(statesQueued == statesDequeued, format("Queued %d states but dequeued only %d!", statesQueued, statesDequeued));
-
-			if (exitSearchStateFound)
+			if (findExitParent<false>())
 			{
 				printTime(); printf("Found (at %d)!          \n", exitSearchStateParentFrame);
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+				exitTraceStates[stepNr] = exitSearchState;
+				exitTraceFrames[stepNr] = exitSearchStateFrame;
+#endif
 				steps[stepNr++]      = exitSearchStateStep;
 				exitSearchState      = exitSearchStateParent;
 				exitSearchStateFrame = exitSearchStateParentFrame;
+#ifdef TRACE_LAST_ACTION
+				exitSearchStateAction = exitSearchStateParentAction;
+#endif
 				if (exitSearchFrameGroup == 0)
 				{
 					exitSearchFrameGroup--;
@@ -3159,126 +4151,15 @@ void traceExit(const State* exitState, FRAME exitFrame)
 found:
     
 	printf("Transcribing solution.\n");
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+	untransformSteps(&exitSearchState, exitSearchStateFrame, steps, stepNr);
+#endif
 	writeSolution(&exitSearchState, steps, stepNr);
     //deleteFile(formatFileName("solution"));
 }
 
 // **************************************** Common runmode code *****************************************
 
-#if 0
-size_t ramUsed;
-
-void sortAndMerge(FRAME_GROUP g)
-{
-	// Step 1: read chunks of BUFFER_SIZE nodes, sort+dedup them in RAM and write them to disk
-	int chunks = 0;
-
-	printf("Sorting... "); fflush(stdout);
-	{
-		InputStream<Node> input(formatFileName("open", g));
-		uint64_t amount = input.size();
-		if (amount > BUFFER_SIZE)
-			amount = BUFFER_SIZE;
-		size_t records;
-		while (records = input.read(buffer, (size_t)amount))
-		{
-			if (ramUsed < records * sizeof(Node))
-				ramUsed = records * sizeof(Node);
-			std::sort(buffer, buffer + records);
-			records = deduplicate(buffer, records);
-			OutputStream output(formatFileName("chunk", g, chunks));
-			output.write(buffer, records);
-			chunks++;
-		}
-	}
-
-	// Step 2: merge + dedup chunks
-	printf("Merging... "); fflush(stdout);
-	if (chunks>1)
-	{
-		ramUsed = RAM_SIZE;
-		double outbuf_inbuf_ratio = sqrt(EXPECTED_MERGING_RATIO * chunks);
-		size_t bufferSize = (size_t)floor(RAM_SIZE / ((chunks + outbuf_inbuf_ratio) * sizeof(Node)));
-		
-		BufferedInputStream<Node>* chunkInput = new BufferedInputStream<Node>[chunks];
-		for (int i=0; i<chunks; i++)
-		{
-			chunkInput[i].setReadBuffer(buffer + i*bufferSize, (uint32_t)bufferSize);
-			chunkInput[i].open(formatFileName("chunk", g, i));
-		}
-		BufferedOutputStream<Node>* output = new BufferedOutputStream<Node>;
-		output->setWriteBuffer(buffer + chunks*bufferSize, (uint32_t)floor(bufferSize * outbuf_inbuf_ratio));
-		output->open(formatFileName("merging", g));
-		mergeStreams(chunkInput, chunks, output);
-		delete[] chunkInput;
-		delete output;
-		renameFile(formatFileName("merging", g), formatFileName("merged", g));
-		//for (int i=0; i<chunks; i++)
-		//	deleteFile(formatFileName("chunk", g, i));
-	}
-	else
-	{
-		renameFile(formatFileName("chunk", g, 0), formatFileName("merged", g));
-	}
-}
-
-// use closed/all files implicitly, optionally update all file by merging input with existing all/closed files
-template <bool updateAll>
-void filterAgainstClosed(BufferedRewriteStream<Node> open[], int openCount)
-{
-	BufferedInputStream* closed = new BufferedInputStream[MAX_FRAME_GROUPS];
-	FRAME_GROUP lastAll = -1, maxClosed = -1;
-	for (FRAME_GROUP g=MAX_FRAME_GROUPS-1; g>=0; g--)
-#ifdef USE_ALL
-		if (fileExists(formatFileName("all", g)))
-		{
-			closed[g].setReadBufferSize(ALL_FILE_BUFFER_SIZE);
-			closed[g].open(formatFileName("all", g));
-			lastAll = g;
-			break;
-		}
-		else
-#endif
-		if (fileExists(formatFileName("closed", g)))
-		{
-			closed[g].open(formatFileName("closed", g));
-			if (maxClosed == -1)
-				maxClosed = g;
-		}
-
-	{
-		InputHeap<BufferedInputStream> closedHeap(closed, MAX_FRAME_GROUPS);
-		
-		if (updateAll)
-		{
-#ifdef USE_ALL
-			enforce(maxClosed >= 0, "No closed node files found");
-			enforce(maxClosed > lastAll, "All file already up-to-date");
-			{
-				BufferedOutputStream all(formatFileName("allnew", maxClosed));
-				filterStreams(&closedHeap, open, openCount, &all);
-			}
-			renameFile(formatFileName("allnew", maxClosed), formatFileName("all", maxClosed));
-			if (lastAll>=0)
-				deleteFile(formatFileName("all", lastAll));
-#else
-			error("USE_ALL not enabled");
-#endif
-		}
-		else
-			filterStreams(&closedHeap, open, openCount, &nullOutput);
-	}
-	delete[] closed;
-	
-	for (FRAME_GROUP g=0; g<openCount; g++) // on success, truncate open nodes manually
-		if (open[g].isOpen())
-		{
-			open[g].flush();
-			open[g].truncate();
-		}
-}
-#endif
-
 bool checkStop(bool newline=false)
 {
 	if (fileExists(formatProblemFileName("stop", NULL, "txt")))
@@ -3291,17 +4172,6 @@ bool checkStop(bool newline=false)
 	return false;
 }
 
-#if 0
-FRAME_GROUP lastAll()
-{
-	for (FRAME_GROUP g=MAX_FRAME_GROUPS-1; g>=0; g--)
-		if (fileExists(formatFileName("all", g)))
-			return g;
-	error("All file not found!");
-	return 0; // compiler complains
-}
-#endif
-
 enum // exit reasons
 {
 	EXIT_OK,
@@ -3310,17 +4180,12 @@ enum // exit reasons
 	EXIT_ERROR
 };
 
-// Forward declarations
-int doSortOpen(FRAME_GROUP firstFrameGroup, FRAME_GROUP maxFrameGroups);
-int filterOpen();
-void doFilterOpen(FRAME_GROUP firstFrameGroup, FRAME_GROUP maxFrameGroups);
-
 // *********************************************** Search ***********************************************
 
 FRAME_GROUP firstFrameGroup, maxFrameGroups;
 
-bool exitFound;
-FRAME exitFrame;
+volatile bool exitFound; // also stops the expansion of the rest of the frame group
+volatile FRAME exitFrame;
 State exitState;
 #ifdef MULTITHREADING
 MUTEX finishMutex;
@@ -3352,73 +4217,233 @@ INLINE bool finishCheck(const State* s, FRAME frame)
 	return false;
 }
 
-void processState(const Node* cs)
+#ifdef HAVE_PATTERN_DATABASE
+// Distance from each abstract state to the closest abstract finish state, indexed by State::patternIndex() of the abstract state.
+// Written by buildPatternDatabase as a flat array, which the search maps into memory as-is.
+typedef uint8_t PATTERN_DATABASE_ENTRY;
+const PATTERN_DATABASE_ENTRY PATTERN_DATABASE_UNREACHABLE = 0xFF;
+MappedFile<PATTERN_DATABASE_ENTRY> patternDatabaseFile;
+const PATTERN_DATABASE_ENTRY* patternDatabase = NULL;
+
+void loadPatternDatabase()
 {
-	State s;
-	s.decompress(&cs->getState());
-#ifdef HAVE_VALIDATOR
-	if (!s.validate())
+	if (!fileExists(formatFileName("pdb")))
 		return;
+	patternDatabaseFile.open(formatFileName("pdb"));
+	enforce(patternDatabaseFile.size() == PATTERN_DATABASE_SIZE, "Pattern database size mismatch");
+	patternDatabase = patternDatabaseFile.data();
+	printf("Using pattern database\n");
+}
 #endif
-#ifdef DEBUG
-	CompressedState test;
-	s.compress(&test);
-	if (test != cs->getState())
+
+#if defined(HAVE_LOWER_BOUND) || defined(HAVE_PATTERN_DATABASE)
+#define USE_LOWER_BOUND
+
+/// Returns true if a child can't lead to a finish state within MAX_FRAMES, or sooner than an exit that was already found.
+/// State::lowerBound() must not overestimate the number of frames from the state to the closest finish.
+/// (The frame group limit of the search command isn't used: pruned children never reach the node files, so a search
+/// resumed with a higher limit would miss them.)
+INLINE bool canPruneChild(const State* state, FRAME frame)
+{
+	FRAME bound = frame;
+#ifdef HAVE_LOWER_BOUND
+	bound += state->lowerBound();
+#endif
+#ifdef HAVE_PATTERN_DATABASE
+	if (patternDatabase)
 	{
-		puts("");
-		puts(hexDump(cs, sizeof(CompressedState)));
-		puts(cs->getState().toString());
-		puts(hexDump(&s, sizeof(State)));
-		puts(s.toString());
-		puts(hexDump(&test, sizeof(CompressedState)));
-		puts(test.toString());
-		error("Compression/decompression failed");
+		State abstractState = *state;
+		abstractState.abstract();
+		PATTERN_DATABASE_ENTRY distance = patternDatabase[abstractState.patternIndex()];
+		if (distance == PATTERN_DATABASE_UNREACHABLE)
+			return true;
+		if (bound < frame + distance)
+			bound = frame + distance;
 	}
 #endif
-	FRAME currentFrame = GET_FRAME(currentFrameGroup, *cs);
-	if (finishCheck(&s, currentFrame))
-		return;
+	return bound > MAX_FRAMES || (exitFound && bound >= exitFrame);
+}
+#endif
 
-	class AddStateChildHandler
-	{
-	public:
+template<bool BACKWARD>
+class AddStateChildHandler
+{
+public:
 #ifdef USE_TRANSFORM_INVARIANT_SORTING
-		enum { PREFERRED = PREFERRED_STATE_TRANSFORM };
+	enum { PREFERRED = PREFERRED_STATE_UNCOMPRESSED };
 #else
-		enum { PREFERRED = PREFERRED_STATE_COMPRESSED };
+	enum { PREFERRED = PREFERRED_STATE_COMPRESSED };
 #endif
 
-#ifdef USE_TRANSFORM_INVARIANT_SORTING
-		static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, CompressedStateTransform transform, FRAME frame)
-		{
-			addStateTransform(transform, frame);
-		}
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const CompressedState* cs, FRAME frame)
+	{
+#if defined(USE_TRANSFORM_INVARIANT_SORTING)
+		const bool needState = true; // to canonicalize it
+#elif defined(HAVE_PATTERN_DATABASE)
+		const bool needState = !BACKWARD || searchAbstract;
+#elif defined(USE_LOWER_BOUND)
+		const bool needState = !BACKWARD;
+#else
+		const bool needState = false;
 #endif
-
-		static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const CompressedState* cs, FRAME frame)
+		if (needState)
 		{
-			addState(cs, frame);
+			State state;
+			state.decompress(cs);
+			handleChild(parent, parentFrame, step, &state, frame);
+			return;
 		}
+		addState(cs, frame, STEP_ACTION(step));
+	}
+
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const State* state, FRAME frame)
+	{
+#if defined(USE_TRANSFORM_INVARIANT_SORTING) || defined(HAVE_PATTERN_DATABASE)
+		State transformedState = *state;
+# ifdef HAVE_PATTERN_DATABASE
+		if (BACKWARD && searchAbstract)
+			transformedState.abstract();
+# endif
+# ifdef USE_TRANSFORM_INVARIANT_SORTING
+		transformedState.canonicalize();
+# endif
+		state = &transformedState;
+#endif
+#ifdef USE_LOWER_BOUND
+		if (!BACKWARD && canPruneChild(state, frame))
+			return;
+#endif
+		CompressedState cs;
+		state->compress(&cs);
+		addState(&cs, frame, STEP_ACTION(step));
+	}
 
-		static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const State* state, FRAME frame)
+#ifdef HAVE_EXPAND_CHILDREN_BATCH
+	/// Adds the children of a batch from expandChildrenBatch. Batches only come from the forward search, and carry no steps
+	/// (which is why TRACE_LAST_ACTION turns batching off).
+	static INLINE void handleChildren(const CompressedState* children, const FRAME* frames, int count)
+	{
+		for (int i=0; i<count; i++)
 		{
+#if defined(USE_TRANSFORM_INVARIANT_SORTING) || defined(USE_LOWER_BOUND)
+			State state;
+			state.decompress(&children[i]);
+# ifdef USE_TRANSFORM_INVARIANT_SORTING
+			state.canonicalize();
+# endif
+# ifdef USE_LOWER_BOUND
+			if (canPruneChild(&state, frames[i]))
+				continue;
+# endif
+#endif
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
 			CompressedState cs;
-			state->compress(&cs);
-			addState(&cs, frame);
+			state.compress(&cs);
+			addState(&cs, frames[i], 0);
+#else
+			addState(&children[i], frames[i], 0);
+#endif
 		}
-	};
+	}
+#endif
+};
+
+#if defined(DEBUG) || defined(VERIFY_COMPRESSION)
+/// Checks that compressing the state decompressed from a node gives back the node's state.
+void verifyCompression(const Node* cs, const State* s)
+{
+	CompressedState test;
+	s->compress(&test);
+	if (test != cs->getState())
+	{
+		puts("");
+		puts(hexDump(cs, sizeof(CompressedState)));
+		puts(cs->getState().toString());
+		puts(hexDump(s, sizeof(State)));
+		puts(s->toString());
+		puts(hexDump(&test, sizeof(CompressedState)));
+		puts(test.toString());
+		error("Compression/decompression failed");
+	}
+}
+#endif
+
+template<bool BACKWARD>
+void processState(const Node* cs)
+{
+	State s;
+	s.decompress(&cs->getState());
+#ifdef HAVE_VALIDATOR
+	if (!s.validate())
+		return;
+#endif
+#if defined(DEBUG) || defined(VERIFY_COMPRESSION)
+	verifyCompression(cs, &s);
+#endif
+	FRAME currentFrame = GET_FRAME(currentFrameGroup, *cs);
+#ifndef USE_GOAL_SET
+	if (!BACKWARD && finishCheck(&s, currentFrame))
+		return;
+#endif
+	if (exitFound)
+		return; // the remaining nodes are only checked for an earlier exit
 
-	expandChildren<AddStateChildHandler>(currentFrame, &s);
+#ifdef BACKWARD_SEARCH
+	if (BACKWARD)
+		expandParents<AddStateChildHandler<BACKWARD> >(currentFrame, &s);
+	else
+#endif
+		expandChildren<AddStateChildHandler<BACKWARD> >(currentFrame, &s);
 	assert(currentFrame/FRAMES_PER_GROUP == currentFrameGroup, format("Run-away currentFrameGroup: currentFrame=%u, currentFrameGroup=%u", currentFrame, currentFrameGroup));
 }
 
+#if defined(HAVE_EXPAND_CHILDREN_BATCH) && defined(MULTITHREADING)
+/// Expands a chunk of dequeued nodes with one call to the problem's expandChildrenBatch.
+void processStateBatch(const Node* nodes, int count)
+{
+	CompressedState states[QUEUE_CHUNK_SIZE];
+	FRAME frames[QUEUE_CHUNK_SIZE];
+	int n = 0;
+	for (int i=0; i<count; i++)
+	{
+		FRAME frame = GET_FRAME(currentFrameGroup, nodes[i]);
+#if defined(HAVE_VALIDATOR) || !defined(USE_GOAL_SET) || defined(DEBUG) || defined(VERIFY_COMPRESSION)
+		State s;
+		s.decompress(&nodes[i].getState());
+# ifdef HAVE_VALIDATOR
+		if (!s.validate())
+			continue;
+# endif
+# if defined(DEBUG) || defined(VERIFY_COMPRESSION)
+		verifyCompression(&nodes[i], &s);
+# endif
+# ifndef USE_GOAL_SET
+		if (finishCheck(&s, frame))
+			continue;
+# endif
+#endif
+		states[n] = nodes[i].getState();
+		frames[n] = frame;
+		n++;
+	}
+	if (exitFound)
+		return; // the remaining nodes are only checked for an earlier exit
+	expandChildrenBatch<AddStateChildHandler<false> >(states, frames, n);
+}
+#endif
+
 INLINE void processFilteredState(const Node* state)
 {
 	//closedNodesInCurrentFrameGroup++;
 #ifdef MULTITHREADING
 	queueState(state);
 #else
-	processState(state, 0);
+# ifdef BACKWARD_SEARCH
+	if (searchBackward)
+		processState<true>(state);
+	else
+# endif
+		processState<false>(state);
 #endif
 }
 
@@ -3436,6 +4461,7 @@ public:
 		{
 			Node cs;
 			(PackedCompressedState&)cs = node->state;
+			COPY_LAST_ACTION(cs, *node);
 #ifdef GROUP_FRAMES
 			cs.subframe = node->frame % FRAMES_PER_GROUP;
 #endif
@@ -3445,16 +4471,18 @@ public:
 	enum { WRITABLE = true };
 };
 
+/// Writes the nodes of the next frame group to the closed node file. The combined node file is written by CombiningOutput,
+/// which also counts its nodes.
 class ClosedNodeFilterOutput
 {
 public:
 	INLINE static void write(const OpenNode* node, bool verify=false)
 	{
-		combinedNodesTotal++;
 		if (node->frame / FRAMES_PER_GROUP == currentFrameGroup+1)
 		{
 			Node cs;
 			(PackedCompressedState&)cs = node->state;
+			COPY_LAST_ACTION(cs, *node);
 #ifdef GROUP_FRAMES
 			cs.subframe = node->frame % FRAMES_PER_GROUP;
 #endif
@@ -3465,8 +4493,83 @@ public:
 	enum { WRITABLE = true };
 };
 
+#ifdef FRONTIER_SEARCH
+/// With reversible moves, a child can't lie more than MAX_FRAME_DELAY frames before its parent, so nodes that far
+/// behind the next frame group to expand can never be reached again and are dropped from the combined node file.
+class FrontierOutput : public BufferedOutputStream<OpenNode>
+{
+public:
+	INLINE void write(const OpenNode* node, bool verify=false)
+	{
+		if (node->frame + MAX_FRAME_DELAY >= (currentFrameGroup+1) * FRAMES_PER_GROUP)
+		{
+			BufferedOutputStream<OpenNode>::write(node, verify);
+			combinedNodesTotal++;
+		}
+	}
+};
+typedef FrontierOutput CombiningOutput;
+#else
+/// Without frontier search, the combined node file keeps all nodes. The batch files of "grouped-search" only keep the nodes
+/// from combiningMinFrame on: older nodes which are found again in the batch are expanded redundantly, and filtered out at its end.
+FRAME combiningMinFrame = 0;
+
+class CombiningOutput : public BufferedOutputStream<OpenNode>
+{
+public:
+	INLINE void write(const OpenNode* node, bool verify=false)
+	{
+		if (node->frame >= combiningMinFrame)
+		{
+			BufferedOutputStream<OpenNode>::write(node, verify);
+			combinedNodesTotal++;
+		}
+	}
+};
+#endif
+
+#ifdef USE_GOAL_SET
+/// Merge-joins the closed node file for frame group g against the sorted goal set file.
+/// Sets exitFound/exitFrame/exitState to the earliest match, if any.
+void joinGoalSet(FRAME_GROUP g)
+{
+	BufferedInputStream<Node> closed(formatFileName("closed", g));
+	BufferedInputStream<Node> goals(formatFileName("goals"));
+
+	const Node* c = closed.read();
+	const Node* goal = goals.read();
+	while (c && goal)
+	{
+		if (*c < *goal)
+			c = closed.read();
+		else
+		if (*c > *goal)
+			goal = goals.read();
+		else
+		{
+			FRAME frame = GET_FRAME(g, *c);
+			if (!exitFound || exitFrame > frame)
+			{
+				exitFound = true;
+				exitFrame = frame;
+				exitState.decompress(&c->getState());
+			}
+			c = closed.read();
+		}
+	}
+}
+#endif
+
 void searchPrintHeader()
 {
+#ifdef BACKWARD_SEARCH
+	if (searchBackward)
+		printf("Backward ");
+# ifdef BIDIRECTIONAL_SEARCH
+	else
+		printf("Forward  ");
+# endif
+#endif
 	printf("Frame" GROUP_STR " " GROUP_ALIGNED_FORMAT "/" GROUP_ALIGNED_FORMAT ": ", currentFrameGroup, maxFrameGroups);
 	fflush(stdout);
 }
@@ -3477,6 +4580,18 @@ void searchPrintNodeCounts()
 	fflush(stdout);
 }
 
+/// Number of frame groups expanded before each rewrite of the combined node file (see the "grouped-search" run mode).
+FRAME_GROUP searchBatchSize = 1;
+/// The frame group whose combined node file the current batch of frame groups started from.
+FRAME_GROUP batchStartFrameGroup;
+
+/// Within a batch, each frame group is combined against a "batchcombined" node file, which only holds the nodes needed
+/// to keep the batch's closed node files free of duplicates, instead of against the full combined node file.
+const char* searchCombinedFileName(FRAME_GROUP g)
+{
+	return formatFileName(g == batchStartFrameGroup ? "combined" : "batchcombined", g);
+}
+
 void searchRecalculateNodeCounts()
 {
 	{
@@ -3484,114 +4599,169 @@ void searchRecalculateNodeCounts()
 		closedNodesInCurrentFrameGroup = getSize.size();
 	}
 	{
-		InputStream<OpenNode> getSize(formatFileName("combined", currentFrameGroup));
+		InputStream<OpenNode> getSize(searchCombinedFileName(currentFrameGroup));
 		combinedNodesTotal = getSize.size();
 	}
 }
 
-const size_t RELATIVE_SIZE_CLOSING   =  20;
-const size_t RELATIVE_SIZE_EXPANDED  = 142;
-const size_t RELATIVE_SIZE_COMBINED  = 189;
-const size_t RELATIVE_SIZE_COMBINING = 234;
+// ******************************************* RAM budget planner *******************************************
 
-int search()
+// The streams of the Extracting and Combining steps, whose buffers share "ram".
+enum RamStream
 {
-	if (fileExists(formatProblemFileName(NULL, NULL, "txt")))
+	RAM_STREAM_CLOSING,   // closed node output
+	RAM_STREAM_EXPANDED,  // expanded node input
+	RAM_STREAM_COMBINED,  // combined node input
+	RAM_STREAM_COMBINING, // combined node output
+	RAM_STREAMS
+};
+const char* ramStreamNames[RAM_STREAMS] = { "closing", "expanded", "combined", "combining" };
+
+/// The relative buffer sizes of the streams. The initial values are a fixed guess; after each Combining step, they are re-planned
+/// from its measurements by ramPlannerUpdate.
+double ramStreamWeights[RAM_STREAMS] = { 20, 142, 189, 234 };
+
+/// Divides "total" buffer nodes between the given streams in proportion to their weights (at least one node each).
+void ramPlan(const RamStream streams[], int count, size_t total, size_t sizes[])
+{
+	double sum = 0;
+	for (int i=0; i<count; i++)
+		sum += ramStreamWeights[streams[i]];
+	size_t left = total;
+	for (int i=0; i<count; i++)
+	{
+		sizes[i] = i==count-1 ? left : (size_t)(total * (ramStreamWeights[streams[i]] / sum));
+		if (sizes[i] < 1)
+			sizes[i] = 1;
+		if (sizes[i] > left - (count-1-i))
+			sizes[i] = left - (count-1-i);
+		left -= sizes[i];
+	}
+}
+
+/// Every buffer refill of a stream costs some time c (mostly spent seeking), so streaming n bytes through a buffer of b bytes
+/// stalls for n/b*c. The total stall over all streams is the smallest with b proportional to sqrt(n*c), so the weights are
+/// moved halfway towards that, from the bytes and stall time measured for each stream during the step that just ended.
+void ramPlannerUpdate(const RamStream streams[], const IOStats stats[], int count)
+{
+	double target[RAM_STREAMS], targetSum = 0, weightSum = 0;
+	for (int i=0; i<count; i++)
 	{
-		printf("Solution already found.\n");
-		return EXIT_OK;
+		weightSum += ramStreamWeights[streams[i]];
+		if (stats[i].transfers == 0 || stats[i].bytes == 0)
+			return; // nothing to learn from an empty stream
+		double cost = (double)(stats[i].microseconds ? stats[i].microseconds : 1) / stats[i].transfers;
+		target[i] = sqrt((double)stats[i].bytes * cost);
+		targetSum += target[i];
+	}
+	for (int i=0; i<count; i++)
+	{
+		double& weight = ramStreamWeights[streams[i]];
+		weight = (weight + target[i] / targetSum * weightSum) / 2;
+		if (weight < weightSum / 100)
+			weight = weightSum / 100; // keep a stream that is quiet now from being starved when it picks up again
 	}
+}
 
-	if (fileExists(formatFileName("solution")))
+enum // search stages to resume from
+{
+	SEARCH_STAGE_EXPANDING,
+	SEARCH_STAGE_MERGING,
+	SEARCH_STAGE_COMBINING,
+};
+
+const int SEARCH_CONTINUE = -1; // returned by searchFrameGroup when the search should go on
+
+timeb searchStartTime, frameGroupStartTime;
+
+/// Creates the combined and closed node files for frame group 0 from the given states.
+void searchCreateInitialFiles(const State* states, int stateCount)
+{
 	{
-		printf("Partial trace solution file present, resuming exit trace...\n");
-		traceExit(NULL, 0);
-		return EXIT_OK;
+		RamArenas arenas;
+		OpenNode* initialCompressedStates = arenas.allocate<OpenNode>("initial states", stateCount);
+		for (int i=0; i<stateCount; i++)
+		{
+			initialCompressedStates[i].frame = 0;
+			SET_LAST_ACTION(initialCompressedStates[i], NO_LAST_ACTION);
+			State state = states[i];
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+			state.canonicalize();
+#endif
+			state.compress(&initialCompressedStates[i].getState());
+		}
+		std::sort(initialCompressedStates, initialCompressedStates + stateCount);
+		combinedNodesTotal = deduplicate(initialCompressedStates, stateCount);
+
+		OutputStream<OpenNode> output(formatFileName("combining", currentFrameGroup), false);
+		output.write(initialCompressedStates, combinedNodesTotal);
 	}
+	{
+		RamArenas arenas;
+		Node* initialCompressedStates = arenas.allocate<Node>("initial states", stateCount);
+		for (int i=0; i<stateCount; i++)
+		{
+#ifdef GROUP_FRAMES
+			initialCompressedStates[i].subframe = 0;
+#endif
+			SET_LAST_ACTION(initialCompressedStates[i], NO_LAST_ACTION);
+			State state = states[i];
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+			state.canonicalize();
+#endif
+			state.compress(&initialCompressedStates[i].getState());
+		}
+		std::sort(initialCompressedStates, initialCompressedStates + stateCount);
+		closedNodesInCurrentFrameGroup = deduplicate(initialCompressedStates, stateCount);
 
+		OutputStream<Node> output(formatFileName("closing", currentFrameGroup), false);
+		output.write(initialCompressedStates, closedNodesInCurrentFrameGroup);
+	}
+	renameFile(formatFileName("combining", currentFrameGroup), formatFileName("combined", currentFrameGroup));
+	renameFile(formatFileName("closing", currentFrameGroup), formatFileName("closed", currentFrameGroup));
+}
+
+/// Finds the frame group to resume from (or starts a new search from the given states), and returns the stage to resume at.
+int searchResume(const State* states, int stateCount)
+{
 	for (currentFrameGroup=MAX_FRAME_GROUPS; currentFrameGroup>=0; currentFrameGroup--)
 		if (fileExists(formatFileName("combined", currentFrameGroup)))
 		{
+			batchStartFrameGroup = currentFrameGroup;
+			// The batch may have been started with a different batch size, so look for its progress beyond the current one
+			for (FRAME_GROUP g=MAX_FRAME_GROUPS; g>currentFrameGroup; g--)
+				if (fileExists(formatFileName("batchcombined", g)))
+				{
+					currentFrameGroup = g;
+					break;
+				}
 			printTime();
 			printf("Resuming from frame" GROUP_STR " " GROUP_FORMAT "\n", currentFrameGroup);
 			break;
 	    }
 
-	timeb time0;
-	ftime(&time0);
-
-	timeb time1 = time0;
-	timeb time2;
-	timeb time3;
+	ftime(&frameGroupStartTime);
 
 	if (currentFrameGroup == -1)
 	{
-		currentFrameGroup = 0;
+		currentFrameGroup = batchStartFrameGroup = 0;
 
 		printTime();
 		printf("Starting search\n");
 
-		{
-			OpenNode* initialCompressedStates = (OpenNode*)ram;
-			for (int i=0; i<initialStateCount; i++)
-			{
-				initialCompressedStates[i].frame = 0;
-				initialStates[i].compress(&initialCompressedStates[i].getState());
-			}
-			std::sort(initialCompressedStates, initialCompressedStates + initialStateCount);
-			combinedNodesTotal = deduplicate(initialCompressedStates, initialStateCount);
-
-			OutputStream<OpenNode> output(formatFileName("combining", currentFrameGroup), false);
-			output.write(initialCompressedStates, combinedNodesTotal);
-		}
-		{
-			Node* initialCompressedStates = (Node*)ram;
-			for (int i=0; i<initialStateCount; i++)
-			{
-#ifdef GROUP_FRAMES
-				initialCompressedStates[i].subframe = 0;
-#endif
-				initialStates[i].compress(&initialCompressedStates[i].getState());
-			}
-			std::sort(initialCompressedStates, initialCompressedStates + initialStateCount);
-			closedNodesInCurrentFrameGroup = deduplicate(initialCompressedStates, initialStateCount);
-
-			OutputStream<Node> output(formatFileName("closing", currentFrameGroup), false);
-			output.write(initialCompressedStates, closedNodesInCurrentFrameGroup);
-		}
-		renameFile(formatFileName("combining", currentFrameGroup), formatFileName("combined", currentFrameGroup));
-		renameFile(formatFileName("closing", currentFrameGroup), formatFileName("closed", currentFrameGroup));
+		searchCreateInitialFiles(states, stateCount);
 	}
 	else
 	if (fileExists(formatFileName("expanded", currentFrameGroup)))
 	{
 		searchRecalculateNodeCounts();
-
-		searchPrintHeader();
-		searchPrintNodeCounts();
-
-		printf("; (Resuming)                                                        "); fflush(stdout);
-
-		time3 = time1;
-
-		goto skipToCombining;
+		return SEARCH_STAGE_COMBINING;
 	}
 	else
 	if (fileExists(formatFileName("expandedcount", currentFrameGroup)))
 	{
 		searchRecalculateNodeCounts();
-		
-		searchPrintHeader();
-		searchPrintNodeCounts();
-
-		printf("; (Resuming)              "); fflush(stdout);
-
-		InputStream<unsigned> resumeInfo(formatFileName("expandedcount", currentFrameGroup));
-		resumeInfo.read(&expansionChunks, 1);
-
-		time2 = time1;
-
-		goto skipToMerging;
+		return SEARCH_STAGE_MERGING;
 	}
 	else	
 	if (fileExists(formatFileName("closed", currentFrameGroup)))
@@ -3607,21 +4777,22 @@ int search()
 		
 		printf("Extracting..."); fflush(stdout);
 
-		const size_t sizeClosing   = (OPENNODE_BUFFER_SIZE              ) * RELATIVE_SIZE_CLOSING   / (RELATIVE_SIZE_CLOSING + RELATIVE_SIZE_COMBINING) ?
-		                             (OPENNODE_BUFFER_SIZE              ) * RELATIVE_SIZE_CLOSING   / (RELATIVE_SIZE_CLOSING + RELATIVE_SIZE_COMBINING) : 1;
-		const size_t sizeCombining = (OPENNODE_BUFFER_SIZE - sizeClosing) * RELATIVE_SIZE_COMBINING / (                        RELATIVE_SIZE_COMBINING) ?
-		                             (OPENNODE_BUFFER_SIZE - sizeClosing) * RELATIVE_SIZE_COMBINING / (                        RELATIVE_SIZE_COMBINING) : 1;
+		const RamStream streams[2] = { RAM_STREAM_CLOSING, RAM_STREAM_COMBINED };
+		size_t sizes[2];
+		ramPlan(streams, 2, OPENNODE_BUFFER_SIZE, sizes);
+		RamArenas arenas;
 
-		closedNodeFile.setWriteBuffer((Node*)ram, sizeClosing * sizeof(OpenNode) / sizeof(Node));
+		closedNodeFile.setWriteBuffer(arenas.allocate<Node>("closing", sizes[0] * sizeof(OpenNode) / sizeof(Node)), sizes[0] * sizeof(OpenNode) / sizeof(Node));
 		closedNodeFile.open(formatFileName("closing", currentFrameGroup), false);
 
 		ClosedNodeFilterOutput output;
 
 		BufferedInputStream<OpenNode> input;
-		input.setReadBuffer((OpenNode*)ram + sizeClosing, (uint32_t)sizeCombining);
-		input.open(formatFileName("combined", currentFrameGroup));
+		input.setReadBuffer(arenas.allocate<OpenNode>("combined", sizes[1]), (BUFFER_INDEX)sizes[1]);
+		input.open(searchCombinedFileName(currentFrameGroup));
 
 		copyStream<OpenNode>(&input, &output);
+		combinedNodesTotal = input.size();
 
 		closedNodeFile.flush();
 		closedNodeFile.close();
@@ -3630,6 +4801,315 @@ int search()
 
 		putchar('\n');
 	}
+	return SEARCH_STAGE_EXPANDING;
+}
+
+#ifdef BARE_EXPANDED_NODES
+/// An input of the Combining step's merge: either a combined node file, or an expanded node file, whose bare nodes are given
+/// the frame they were expanded into, so that both kinds can be merged by one InputHeap.
+class CombiningInputStream
+{
+	BufferedInputStream<OpenNode> combined;
+	BufferedInputStream<ExpandedNode> expanded;
+	bool bare;
+	OpenNode node;
+
+public:
+	CombiningInputStream() : combined((BUFFER_INDEX)0), expanded((BUFFER_INDEX)0), bare(false) {}
+
+	/// Both streams share the buffer; only the one which is opened uses it.
+	void setReadBuffer(OpenNode* buf, BUFFER_INDEX size)
+	{
+		combined.setReadBuffer(buf, size);
+		expanded.setReadBuffer((ExpandedNode*)buf, (BUFFER_INDEX)(size * sizeof(OpenNode) / sizeof(ExpandedNode)));
+	}
+
+	void open(const char* filename) { combined.open(filename); bare = false; }
+
+	void openExpanded(const char* filename, FRAME frame)
+	{
+		expanded.open(filename);
+		bare = true;
+		memset(&node, 0, sizeof(node));
+		node.frame = (PACKED_FRAME)frame;
+	}
+
+	bool isOpen() { return bare ? expanded.isOpen() : combined.isOpen(); }
+
+	INLINE const OpenNode* read()
+	{
+		if (!bare)
+			return combined.read();
+		const ExpandedNode* e = expanded.read();
+		if (e == NULL)
+			return NULL;
+		node.state = e->state;
+		COPY_LAST_ACTION(node, *e);
+		return &node;
+	}
+
+	void rewind() { if (bare) expanded.rewind(); else combined.rewind(); }
+	void seek(uint64_t position) { if (bare) expanded.seek(position); else combined.seek(position); }
+	uint64_t headPosition() { return bare ? expanded.headPosition() : combined.headPosition(); }
+	const IOStats& ioStats() { return bare ? expanded.ioStats() : combined.ioStats(); }
+};
+#else
+class CombiningInputStream : public BufferedInputStream<OpenNode>
+{
+public:
+	void openExpanded(const char* filename, FRAME frame) { open(filename); }
+};
+#endif
+
+/// The closed node files of the batch's frame groups after the first one, which are rewritten when the batch ends.
+BufferedOutputStream<Node>* batchClosedNodeFiles;
+
+class BatchClosedNodeFilterOutput
+{
+public:
+	INLINE static void write(const OpenNode* node, bool verify=false)
+	{
+		FRAME_GROUP g = node->frame / FRAMES_PER_GROUP;
+		if (g > batchStartFrameGroup && g <= currentFrameGroup+1)
+		{
+			Node cs;
+			(PackedCompressedState&)cs = node->state;
+			COPY_LAST_ACTION(cs, *node);
+#ifdef GROUP_FRAMES
+			cs.subframe = node->frame % FRAMES_PER_GROUP;
+#endif
+			batchClosedNodeFiles[g - batchStartFrameGroup - 1].write(&cs);
+			if (g == currentFrameGroup+1)
+				closedNodesInCurrentFrameGroup++;
+		}
+	}
+	enum { WRITABLE = true };
+};
+
+/// Ends a batch of frame groups: merges the combined node file it started from with the expanded node files of all
+/// its frame groups, producing the next combined node file, and rewriting the batch's closed node files without the
+/// nodes which were already known before the batch.
+void combineBatch()
+{
+	FRAME_GROUP first = batchStartFrameGroup;
+	int count = currentFrameGroup+1 - first;
+#ifndef FRONTIER_SEARCH
+	combiningMinFrame = 0;
+#endif
+
+	const size_t bufferSize = OPENNODE_BUFFER_SIZE / (2*count + 2);
+	enforce(bufferSize, "Too many frame" GROUP_STR "s in one batch for the available RAM");
+
+	RamArenas arenas;
+	CombiningInputStream* inputs = new CombiningInputStream[count+1];
+	inputs[0].setReadBuffer(arenas.allocate<OpenNode>("combined", bufferSize), (BUFFER_INDEX)bufferSize);
+	inputs[0].open(formatFileName("combined", first));
+	for (int i=0; i<count; i++)
+	{
+		inputs[1+i].setReadBuffer(arenas.allocate<OpenNode>("expanded", bufferSize), (BUFFER_INDEX)bufferSize);
+		inputs[1+i].openExpanded(formatFileName("expanded", first+i), (first+i+1) * FRAMES_PER_GROUP);
+	}
+
+	batchClosedNodeFiles = new BufferedOutputStream<Node>[count];
+	for (int i=0; i<count; i++)
+	{
+		if (fileExists(formatFileName("closing", first+1+i)))
+			deleteFile(formatFileName("closing", first+1+i));
+		batchClosedNodeFiles[i].setWriteBuffer(arenas.allocate<Node>("closing", bufferSize * sizeof(OpenNode) / sizeof(Node)), (BUFFER_INDEX)(bufferSize * sizeof(OpenNode) / sizeof(Node)));
+		batchClosedNodeFiles[i].open(formatFileName("closing", first+1+i));
+	}
+
+	{
+		DoubleOutput<OpenNode, BatchClosedNodeFilterOutput, CombiningOutput> output;
+		size_t combiningSize = arenas.remaining<OpenNode>();
+		output.b()->setWriteBuffer(arenas.allocate<OpenNode>("combining", combiningSize), (BUFFER_INDEX)combiningSize);
+		if (fileExists(formatFileName("combining", currentFrameGroup+1)))
+			deleteFile(formatFileName("combining", currentFrameGroup+1));
+		output.b()->open(formatFileName("combining", currentFrameGroup+1));
+		mergeStreams<OpenNode>(inputs, count+1, &output);
+	}
+	delete[] inputs;
+
+	for (int i=0; i<count; i++)
+	{
+		FRAME_GROUP g = first+1+i;
+		bool empty = batchClosedNodeFiles[i].position()==0;
+		batchClosedNodeFiles[i].close();
+		batchClosedNodeFiles[i].clearBuffer(); // prevent bytes from Nodes from becoming junk inside OpenNode padding
+		if (empty && g <= currentFrameGroup) // expanded frame groups without nodes have no closed node file
+		{
+			deleteFile(formatFileName("closing", g));
+			if (fileExists(formatFileName("closed", g)))
+				deleteFile(formatFileName("closed", g));
+		}
+		else
+			renameFile(formatFileName("closing", g), formatFileName("closed", g), true);
+	}
+	delete[] batchClosedNodeFiles;
+	batchClosedNodeFiles = NULL;
+	renameFile(formatFileName("combining", currentFrameGroup+1), formatFileName("combined", currentFrameGroup+1));
+#ifndef KEEP_PAST_FILES
+	deleteFile(formatFileName("combined", first));
+#endif
+	deleteFile(formatFileName("batchcombined", currentFrameGroup));
+#ifndef KEEP_PAST_FILES
+	for (FRAME_GROUP g=first; g<=currentFrameGroup; g++)
+		deleteFile(formatFileName("expanded", g));
+#endif
+}
+
+/// Merges the expanded node file for currentFrameGroup with the combined node file, producing the closed node file for the next
+/// frame group. Inside a batch of frame groups, the output is the next "batchcombined" node file instead of the combined one.
+void combineFrameGroup(bool batchEnd)
+{
+	const char* combiningName = batchEnd ? "combining" : "batchcombining";
+	const char* combinedName  = batchEnd ? "combined"  : "batchcombined";
+#ifndef FRONTIER_SEARCH
+	combiningMinFrame = batchEnd ? 0 : batchStartFrameGroup * FRAMES_PER_GROUP;
+#endif
+
+	const RamStream streams[4] = { RAM_STREAM_CLOSING, RAM_STREAM_EXPANDED, RAM_STREAM_COMBINED, RAM_STREAM_COMBINING };
+	size_t sizes[4];
+	ramPlan(streams, 4, OPENNODE_BUFFER_SIZE, sizes);
+	RamArenas arenas;
+	IOStats stats[4];
+
+	MergeCheckpoint checkpoint;
+	uint64_t inputPositions[2];
+	bool resuming = loadMergeCheckpoint(formatFileName("combiningprogress", currentFrameGroup), &checkpoint, inputPositions, 2);
+	if (resuming)
+	{
+		printf(" (Resuming after %llu nodes)", (unsigned long long)checkpoint.outputSizes[0]); fflush(stdout);
+		closedNodesInCurrentFrameGroup = checkpoint.closedNodes;
+		combinedNodesTotal = checkpoint.combinedNodes;
+		truncateFile(formatFileName(combiningName, currentFrameGroup+1), checkpoint.outputSizes[0] * sizeof(OpenNode));
+		truncateFile(formatFileName("closing"  , currentFrameGroup+1), checkpoint.outputSizes[1] * sizeof(Node));
+	}
+	else
+	{
+		if (fileExists(formatFileName(combiningName, currentFrameGroup+1)))
+			deleteFile(formatFileName(combiningName, currentFrameGroup+1));
+		if (fileExists(formatFileName("closing", currentFrameGroup+1)))
+			deleteFile(formatFileName("closing", currentFrameGroup+1));
+	}
+
+	closedNodeFile.setWriteBuffer(arenas.allocate<Node>("closing", sizes[0] * sizeof(OpenNode) / sizeof(Node)), sizes[0] * sizeof(OpenNode) / sizeof(Node));
+	closedNodeFile.open(formatFileName("closing", currentFrameGroup+1), resuming);
+	IOStats closedStatsBefore = closedNodeFile.ioStats();
+#ifdef PREALLOCATE_COMBINING
+	uint64_t previousClosedSize;
+	if (!resuming)
+	{
+		previousClosedSize = getFileSize(formatFileName("closed", currentFrameGroup));
+#ifdef ESTIMATE_CARDINALITY
+		if (cardinalityEstimate.valid)
+			previousClosedSize = (uint64_t)(cardinalityEstimate.newClosed * CARDINALITY_MARGIN) * sizeof(Node);
+#endif
+#ifdef USE_UNBUFFERED_DISK_IO
+		previousClosedSize = (previousClosedSize + 0x1FF) & -0x200;
+#endif
+		closedNodeFile.preallocate(previousClosedSize);
+	}
+#endif
+
+	{
+		CombiningInputStream inputs[2];
+		DoubleOutput<OpenNode, ClosedNodeFilterOutput, CombiningOutput> output;
+
+		inputs[1].setReadBuffer(arenas.allocate<OpenNode>("expanded", sizes[1]), (BUFFER_INDEX)sizes[1]);
+		inputs[1].openExpanded(formatFileName("expanded", currentFrameGroup), (currentFrameGroup+1) * FRAMES_PER_GROUP);
+
+		inputs[0].setReadBuffer(arenas.allocate<OpenNode>("combined", sizes[2]), (BUFFER_INDEX)sizes[2]);
+		inputs[0].open(searchCombinedFileName(currentFrameGroup));
+
+		output.b()->setWriteBuffer(arenas.allocate<OpenNode>("combining", sizes[3]), (BUFFER_INDEX)sizes[3]);
+		output.b()->open(formatFileName(combiningName, currentFrameGroup+1), resuming);
+#ifdef PREALLOCATE_COMBINING
+		uint64_t previousCombinedSize;
+		if (!resuming)
+		{
+			previousCombinedSize = getFileSize(searchCombinedFileName(currentFrameGroup));
+#ifdef ESTIMATE_CARDINALITY
+			if (cardinalityEstimate.valid)
+				previousCombinedSize += (uint64_t)(cardinalityEstimate.newNodes * CARDINALITY_MARGIN) * sizeof(OpenNode);
+#endif
+#ifdef USE_UNBUFFERED_DISK_IO
+			previousCombinedSize = (previousCombinedSize + 0x1FF) & -0x200;
+#endif
+			output.b()->preallocate(previousCombinedSize);
+		}
+#endif
+
+		if (resuming)
+			seekMergeInputs<OpenNode>(formatFileName("combiningprogress", currentFrameGroup), checkpoint, inputs, inputPositions, 2);
+
+		MergeProgress<CombiningOutput, BufferedOutputStream<Node> > progress("combiningprogress", output.b(), &closedNodeFile);
+		mergeStreams<OpenNode>(inputs, 2, &output, &progress);
+		output.b()->flushBuffer();
+		stats[1] = inputs[1].ioStats();
+		stats[2] = inputs[0].ioStats();
+		stats[3] = output.b()->ioStats();
+	}
+
+	closedNodeFile.close();
+	closedNodeFile.clearBuffer(); // prevent bytes from Nodes from becoming junk inside OpenNode padding
+	stats[0] = closedNodeFile.ioStats().since(closedStatsBefore);
+	ramPlannerUpdate(streams, stats, 4);
+	if (fileExists(formatFileName("combiningprogress", currentFrameGroup)))
+		deleteFile(formatFileName("combiningprogress", currentFrameGroup));
+	renameFile(formatFileName("closing", currentFrameGroup+1), formatFileName("closed", currentFrameGroup+1));
+	if (currentFrameGroup > batchStartFrameGroup)
+		deleteFile(searchCombinedFileName(currentFrameGroup));
+#ifndef KEEP_PAST_FILES
+	else
+	if (batchEnd)
+		deleteFile(searchCombinedFileName(currentFrameGroup));
+#endif
+	renameFile(formatFileName(combiningName, currentFrameGroup+1), formatFileName(combinedName, currentFrameGroup+1));
+#ifndef KEEP_PAST_FILES
+	if (batchEnd) // the batch's expanded node files are merged again when it ends
+		deleteFile(formatFileName("expanded", currentFrameGroup));
+#endif
+}
+
+/// Runs the Expanding, Merging and Combining steps for currentFrameGroup and the frame groups after it, starting at the given stage.
+/// With "single", returns SEARCH_CONTINUE after advancing currentFrameGroup by one; otherwise returns once the search is over.
+int searchFrameGroups(int stage, bool single)
+{
+	timeb time1 = frameGroupStartTime;
+	timeb time2;
+	timeb time3;
+
+#ifdef ESTIMATE_CARDINALITY
+	cardinalityEstimate.valid = false;
+#endif
+
+	if (stage == SEARCH_STAGE_COMBINING)
+	{
+		searchPrintHeader();
+		searchPrintNodeCounts();
+
+		printf("; (Resuming)                                                        "); fflush(stdout);
+
+		time3 = time1;
+
+		goto skipToCombining;
+	}
+	else
+	if (stage == SEARCH_STAGE_MERGING)
+	{
+		searchPrintHeader();
+		searchPrintNodeCounts();
+
+		printf("; (Resuming)              "); fflush(stdout);
+
+		InputStream<unsigned> resumeInfo(formatFileName("expandedcount", currentFrameGroup));
+		resumeInfo.read(&expansionChunks, 1);
+
+		time2 = time1;
+
+		goto skipToMerging;
+	}
 
 	for (;; currentFrameGroup++)
 	{
@@ -3642,35 +5122,126 @@ int search()
 		if (checkStop(true))
 			return EXIT_STOP;
 
+		loadOptionsFile();
+
+#ifdef USE_GOAL_SET
+# ifdef BACKWARD_SEARCH
+		if (!searchBackward)
+# endif
+		if (fileExists(formatFileName("closed", currentFrameGroup)))
+		{
+			joinGoalSet(currentFrameGroup);
+			if (exitFound)
+			{
+				putchar('\n');
+				printTime();
+				printf("Exit found (at frame %u), tracing path...\n", exitFrame);
+				traceExit(&exitState, exitFrame);
+				return EXIT_OK;
+			}
+		}
+#endif
+
 		printf("; Expanding..."); fflush(stdout);
 
 		{
-			BufferedInputStream<Node> input(CLOSED_IN_BUFFER_SIZE); // allocate buffer outside of "ram"; reserve "ram" exclusively for expansion
-			input.open(formatFileName("closed", currentFrameGroup));
+			ExpansionCheckpoint checkpoint = loadExpansionCheckpoint();
+			if (checkpoint.position)
+			{
+				printf(" (Resuming from node %llu)", (unsigned long long)checkpoint.position); fflush(stdout);
+			}
+
+			uint64_t closedSize;
+			{
+				InputStream<Node> getSize(formatFileName("closed", currentFrameGroup));
+				closedSize = getSize.size();
+			}
+			BufferedSplitInputStream<Node> input(closedInBufferSize); // allocate buffer outside of "ram"; reserve "ram" exclusively for expansion
+			input.open(formatFileName("closed", currentFrameGroup), checkpoint.position, closedSize);
 
 			ProcessStateOutput output;
 
-			initExpansion();
+#ifdef ESTIMATE_CARDINALITY
+			bool sketchComplete = checkpoint.position == 0; // the sketches of an earlier process are lost
+			cardinalityStartExpanding();
+#endif
+
+			// The closed node file is expanded in segments. At the end of each segment, all buffered children are written out
+			// as chunks and a checkpoint is saved, which a restarted search can resume from.
+			uint64_t position = checkpoint.position;
+			bool done = false;
+			while (!done)
+			{
+				initExpansion();
+				expansionChunks = checkpoint.chunks;
 
 #ifdef MULTITHREADING
-			startWorkers<&processState,&expansionSortFinalRegions>();
+# ifdef BACKWARD_SEARCH
+				if (searchBackward)
+					startWorkers<&processState<true>,&expansionSortFinalRegions>();
+				else
+# endif
+# ifdef HAVE_EXPAND_CHILDREN_BATCH
+					startBatchWorkers<&processStateBatch,&expansionSortFinalRegions>();
+# else
+					startWorkers<&processState<false>,&expansionSortFinalRegions>();
+# endif
 #endif
-			copyStream<Node>(&input, &output);
+				time_t checkpointTime = time(NULL) + EXPANSION_CHECKPOINT_INTERVAL;
+				for (;;)
+				{
+					const Node* node = input.read();
+					if (!node)
+					{
+						done = true;
+						break;
+					}
+					position++;
+#ifdef ESTIMATE_CARDINALITY
+					cardinalityAddClosed(node);
+#endif
+					// Once an exit has been found, only the nodes from earlier frames still need to be checked for an exit.
+					if (exitFound && GET_FRAME(currentFrameGroup, *node) >= exitFrame)
+					{
+						if (FRAMES_PER_GROUP == 1)
+						{
+							done = true;
+							break;
+						}
+						continue;
+					}
+					output.write(node);
+					if (EXPANSION_CHECKPOINT_INTERVAL && (position & 0xFFFF) == 0 && time(NULL) >= checkpointTime)
+						break;
+				}
 #ifdef MULTITHREADING
-			flushProcessingQueue();
+				flushProcessingQueue();
 #endif
 
-			expansionWriteFinalChunk();
+				if (exitFound)
+				{
+					expansionDiscard();
+					break;
+				}
+				expansionWriteFinalChunk();
 
-			//input.clearBuffer(); // prevent bytes from Nodes from becoming junk inside OpenNode padding
-		}
+				if (!done)
+				{
+					unsigned previousChunks = checkpoint.chunks;
+					checkpoint.position = position;
+					checkpoint.chunks   = expansionChunks;
+					saveExpansionCheckpoint(&checkpoint, previousChunks);
+					if (checkStop(true))
+						return EXIT_STOP;
+				}
+			}
 
-		{
-			OutputStream<unsigned> resumeInfo(formatFileName("expandedcount", currentFrameGroup), false);
-			resumeInfo.write(&expansionChunks, 1);
+			//input.clearBuffer(); // prevent bytes from Nodes from becoming junk inside OpenNode padding
+#ifdef ESTIMATE_CARDINALITY
+			if (sketchComplete && !exitFound)
+				cardinalityFinishExpanding();
+#endif
 		}
-		if (closedNodesInCurrentFrameGroup==0)
-			deleteFile(formatFileName("closed", currentFrameGroup));
 
 		if (exitFound)
 		{
@@ -3682,6 +5253,15 @@ int search()
 			return EXIT_OK;
 		}
 
+		{
+			OutputStream<unsigned> resumeInfo(formatFileName("expandedcount", currentFrameGroup), false);
+			resumeInfo.write(&expansionChunks, 1);
+		}
+		if (fileExists(formatFileName("expandingcheckpoint", currentFrameGroup)))
+			deleteFile(formatFileName("expandingcheckpoint", currentFrameGroup));
+		if (closedNodesInCurrentFrameGroup==0)
+			deleteFile(formatFileName("closed", currentFrameGroup));
+
 		ftime(&time2);
 		{
 			time_t ms = (time2.time - time1.time)*1000 + (time2.millitm - time1.millitm);
@@ -3696,6 +5276,12 @@ int search()
 	skipToMerging:
 
 		printf("Merging..."); fflush(stdout);
+#ifdef ESTIMATE_CARDINALITY
+		if (cardinalityEstimate.valid)
+		{
+			printf(" (est. %llu nodes)", cardinalityEstimate.expanded); fflush(stdout);
+		}
+#endif
 		mergeExpanded();
 
 #ifndef KEEP_PAST_FILES
@@ -3704,7 +5290,7 @@ int search()
 
 		ftime(&time3);
 		{
-			InputStream<OpenNode> getSize(formatFileName("expanded", currentFrameGroup));
+			InputStream<ExpandedNode> getSize(formatFileName("expanded", currentFrameGroup));
 			uint64_t expandedNodes = getSize.size();
 
 			time_t ms = (time3.time - time2.time)*1000 + (time3.millitm - time2.millitm);
@@ -3723,285 +5309,575 @@ int search()
 		
 		printf("Combining..."); fflush(stdout);
 
-		const size_t sizeClosing  =    (OPENNODE_BUFFER_SIZE                                            ) * RELATIVE_SIZE_CLOSING   / (RELATIVE_SIZE_CLOSING + RELATIVE_SIZE_EXPANDED + RELATIVE_SIZE_COMBINED + RELATIVE_SIZE_COMBINING) ?
-		                               (OPENNODE_BUFFER_SIZE                                            ) * RELATIVE_SIZE_CLOSING   / (RELATIVE_SIZE_CLOSING + RELATIVE_SIZE_EXPANDED + RELATIVE_SIZE_COMBINED + RELATIVE_SIZE_COMBINING) : 1;
-		const size_t sizeExpanded =    (OPENNODE_BUFFER_SIZE - sizeClosing                              ) * RELATIVE_SIZE_EXPANDED  / (                        RELATIVE_SIZE_EXPANDED + RELATIVE_SIZE_COMBINED + RELATIVE_SIZE_COMBINING) ?
-		                               (OPENNODE_BUFFER_SIZE - sizeClosing                              ) * RELATIVE_SIZE_EXPANDED  / (                        RELATIVE_SIZE_EXPANDED + RELATIVE_SIZE_COMBINED + RELATIVE_SIZE_COMBINING) : 1;
-		const size_t sizeCombined =    (OPENNODE_BUFFER_SIZE - sizeClosing - sizeExpanded               ) * RELATIVE_SIZE_COMBINED  / (                                                 RELATIVE_SIZE_COMBINED + RELATIVE_SIZE_COMBINING) ?
-		                               (OPENNODE_BUFFER_SIZE - sizeClosing - sizeExpanded               ) * RELATIVE_SIZE_COMBINED  / (                                                 RELATIVE_SIZE_COMBINED + RELATIVE_SIZE_COMBINING) : 1;
-		const size_t sizeCombinedNew = (OPENNODE_BUFFER_SIZE - sizeClosing - sizeExpanded - sizeCombined) * RELATIVE_SIZE_COMBINING / (                                                                          RELATIVE_SIZE_COMBINING) ?
-		                               (OPENNODE_BUFFER_SIZE - sizeClosing - sizeExpanded - sizeCombined) * RELATIVE_SIZE_COMBINING / (                                                                          RELATIVE_SIZE_COMBINING) : 1;
-
-		closedNodeFile.setWriteBuffer((Node*)ram, sizeClosing * sizeof(OpenNode) / sizeof(Node));
-		closedNodeFile.open(formatFileName("closing", currentFrameGroup+1), false);
-#ifdef PREALLOCATE_COMBINING
-		uint64_t previousClosedSize;
+		bool batchEnd = currentFrameGroup+1 - batchStartFrameGroup >= searchBatchSize || currentFrameGroup+1 >= maxFrameGroups;
+		if (batchEnd && currentFrameGroup > batchStartFrameGroup)
 		{
-			previousClosedSize = getFileSize(formatFileName("closed", currentFrameGroup));
-#ifdef USE_UNBUFFERED_DISK_IO
-			previousClosedSize = (previousClosedSize + 0x1FF) & -0x200;
+			printf(" (Frame" GROUP_STR "s " GROUP_FORMAT "-" GROUP_FORMAT ")", batchStartFrameGroup, currentFrameGroup); fflush(stdout);
+			combineBatch();
+		}
+		else
+		{
+#ifdef ESTIMATE_CARDINALITY
+			if (cardinalityEstimate.valid)
+			{
+				printf(" (est. %llu new nodes)", cardinalityEstimate.newClosed); fflush(stdout);
+			}
 #endif
+			combineFrameGroup(batchEnd);
 		}
-		closedNodeFile.preallocate(previousClosedSize);
+
+		timeb time4;
+		ftime(&time4);
+		{
+			time_t ms         = (time4.time - time3.time)*1000 + (time4.millitm - time3.millitm);
+			time_t ms_total   = (time4.time - time1.time)*1000 + (time4.millitm - time1.millitm);
+#ifdef PRINT_RUNNING_TOTAL_TIME
+			time_t ms_running = (time4.time - searchStartTime.time)*1000 + (time4.millitm - searchStartTime.millitm);
+			printf("%4d.%03d s (%4d.%03d s, %6d.%03d s)", ms/1000, ms%1000, ms_total/1000, ms_total%1000, ms_running/1000, ms_running%1000);
+#else
+			printf("%4d.%03d s (%4d.%03d s)", ms/1000, ms%1000, ms_total/1000, ms_total%1000);
 #endif
+		}
+		frameGroupStartTime = time1 = time4;
 
+		putchar('\n');
+
+#ifdef ESTIMATE_CARDINALITY
+		cardinalityEstimate.valid = false;
+#endif
+		if (batchEnd)
+			batchStartFrameGroup = currentFrameGroup+1;
+		if (single)
 		{
-			BufferedInputStream<OpenNode> inputs[2];
-			DoubleOutput<OpenNode, ClosedNodeFilterOutput, BufferedOutputStream<OpenNode>> output;
+			currentFrameGroup++;
+			return SEARCH_CONTINUE;
+		}
+	}
 
-			inputs[1].setReadBuffer((OpenNode*)ram + sizeClosing, sizeExpanded);
-			inputs[1].open(formatFileName("expanded", currentFrameGroup));
+	printf("Exit not found.\n");
+	return EXIT_NOTFOUND;
+}
 
-			inputs[0].setReadBuffer((OpenNode*)ram + sizeClosing + sizeExpanded, sizeCombined);
-			inputs[0].open(formatFileName("combined", currentFrameGroup));
+#ifdef BIDIRECTIONAL_SEARCH
 
-			output.b()->setWriteBuffer((OpenNode*)ram + sizeClosing + sizeExpanded + sizeCombined, (uint32_t)sizeCombinedNew);
-			output.b()->open(formatFileName("combining", currentFrameGroup+1), false);
-#ifdef PREALLOCATE_COMBINING
-			uint64_t previousCombinedSize;
-			{
-				previousCombinedSize = getFileSize(formatFileName("combined", currentFrameGroup));
-#ifdef USE_UNBUFFERED_DISK_IO
-				previousCombinedSize = (previousCombinedSize + 0x1FF) & -0x200;
+#ifndef MAX_FRAME_DELAY
+#error BIDIRECTIONAL_SEARCH requires the problem to define MAX_FRAME_DELAY
 #endif
-			}
-			output.b()->preallocate(previousCombinedSize);
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+#error BIDIRECTIONAL_SEARCH cannot trace through canonical states yet
 #endif
 
-			mergeStreams<OpenNode>(inputs, 2, &output);
+// The backward search runs the same machinery from the finish states, using the problem's expandParents.
+// Its files are kept apart from the forward search's by searchFileNamePrefix.
+// After each frame group, the newest closed node file of the side that advanced is merge-joined against
+// the combined node file of the other side. An intersection gives an upper bound on the solution length;
+// once no undiscovered path can be shorter, the path through the meeting state is traced in both directions.
+
+enum { SEARCH_SIDE_FORWARD, SEARCH_SIDE_BACKWARD };
+
+struct SearchSide
+{
+	const char* fileNamePrefix;
+	FRAME_GROUP currentFrameGroup;
+	uint64_t closedNodesInCurrentFrameGroup, combinedNodesTotal;
+	timeb frameGroupStartTime;
+	int stage;
+} searchSides[2] = { { "" }, { "backward-" } };
+int currentSearchSide = SEARCH_SIDE_FORWARD;
+
+void switchSearchSide(int side)
+{
+	SearchSide& from = searchSides[currentSearchSide];
+	from.currentFrameGroup              = currentFrameGroup;
+	from.closedNodesInCurrentFrameGroup = closedNodesInCurrentFrameGroup;
+	from.combinedNodesTotal             = combinedNodesTotal;
+	from.frameGroupStartTime            = frameGroupStartTime;
+
+	currentSearchSide = side;
+	SearchSide& to = searchSides[side];
+	currentFrameGroup              = to.currentFrameGroup;
+	closedNodesInCurrentFrameGroup = to.closedNodesInCurrentFrameGroup;
+	combinedNodesTotal             = to.combinedNodesTotal;
+	frameGroupStartTime            = to.frameGroupStartTime;
+	batchStartFrameGroup           = currentFrameGroup; // each side combines every frame group
+	searchFileNamePrefix           = to.fileNamePrefix;
+	searchBackward                 = side == SEARCH_SIDE_BACKWARD;
+}
+
+/// The best intersection of the two searches found so far. Saved to disk after every join, for resuming.
+struct
+{
+	bool found;
+	CompressedState state;
+	FRAME frames[2]; // indexed by search side
+	FRAME_GROUP joinedFrameGroups[2]; // the last closed node file of each side that was joined against the other side
+} meeting;
+
+void saveMeeting()
+{
+	FILE* f = fopen(formatFileName("meeting"), "wb");
+	enforce(f, format("Can't create %s", formatFileName("meeting")));
+	enforce(fwrite(&meeting, sizeof(meeting), 1, f) == 1, format("Error writing %s", formatFileName("meeting")));
+	enforce(fclose(f) == 0, format("Error writing %s", formatFileName("meeting")));
+}
+
+void loadMeeting()
+{
+	FILE* f = fopen(formatFileName("meeting"), "rb");
+	enforce(f, format("Can't open %s", formatFileName("meeting")));
+	enforce(fread(&meeting, sizeof(meeting), 1, f) == 1, format("Error reading %s", formatFileName("meeting")));
+	fclose(f);
+}
+
+/// Merge-joins the closed node file for currentFrameGroup against the other side's combined node file.
+void bidirectionalJoin()
+{
+	int side = currentSearchSide;
+	switchSearchSide(!side);
+	const char* combinedFileName = formatFileName("combined", currentFrameGroup);
+	switchSearchSide(side);
+
+	if (fileExists(formatFileName("closed", currentFrameGroup)))
+	{
+		BufferedInputStream<Node> closed(formatFileName("closed", currentFrameGroup));
+		BufferedInputStream<OpenNode> combined(combinedFileName);
+
+		const Node* c = closed.read();
+		const OpenNode* o = combined.read();
+		while (c && o)
+		{
+			if (c->getState() < o->getState())
+				c = closed.read();
+			else
+			if (c->getState() > o->getState())
+				o = combined.read();
+			else
+			{
+				FRAME frame = GET_FRAME(currentFrameGroup, *c), otherFrame = getFrame(o);
+				if (!meeting.found || frame + otherFrame < meeting.frames[side] + meeting.frames[!side])
+				{
+					meeting.found = true;
+					meeting.state = c->getState();
+					meeting.frames[side] = frame;
+					meeting.frames[!side] = otherFrame;
+				}
+				c = closed.read();
+				o = combined.read();
+			}
 		}
+	}
 
-		closedNodeFile.close();
-		closedNodeFile.clearBuffer(); // prevent bytes from Nodes from becoming junk inside OpenNode padding
-		renameFile(formatFileName("closing", currentFrameGroup+1), formatFileName("closed", currentFrameGroup+1));
-#ifndef KEEP_PAST_FILES
-		deleteFile(formatFileName("combined", currentFrameGroup));
+	meeting.joinedFrameGroups[side] = currentFrameGroup;
+	saveMeeting();
+}
+
+/// Returns true if no path which has not been found by bidirectionalJoin yet can be shorter than the meeting.
+bool bidirectionalMeetingIsOptimal()
+{
+	if (!meeting.found)
+		return false;
+	// All states up to these frames have been closed and joined on their respective sides.
+	FRAME forwardFrame  = (searchSides[SEARCH_SIDE_FORWARD ].currentFrameGroup+1) * FRAMES_PER_GROUP - 1;
+	FRAME backwardFrame = (searchSides[SEARCH_SIDE_BACKWARD].currentFrameGroup+1) * FRAMES_PER_GROUP - 1;
+	return meeting.frames[SEARCH_SIDE_FORWARD] + meeting.frames[SEARCH_SIDE_BACKWARD] <= forwardFrame + backwardFrame + 2 - MAX_FRAME_DELAY;
+}
+
+/// Traces the path from the meeting state to a finish state through the backward search's closed node files.
+/// Steps are written in the order they are performed. Returns the number of steps.
+int traceBackward(Step steps[])
+{
+	int stepNr = 0;
+	exitSearchState.decompress(&meeting.state);
+	exitSearchStateFrame = meeting.frames[SEARCH_SIDE_BACKWARD];
+#ifdef TRACE_LAST_ACTION
+	exitSearchStateAction = NO_LAST_ACTION;
 #endif
-		renameFile(formatFileName("combining", currentFrameGroup+1), formatFileName("combined", currentFrameGroup+1));
-#ifndef KEEP_PAST_FILES
-		deleteFile(formatFileName("expanded", currentFrameGroup));
+	exitSearchFrameGroup = exitSearchStateFrame / FRAMES_PER_GROUP;
+
+	while (exitSearchStateFrame > 0)
+	{
+		if (--exitSearchFrameGroup < 0)
+			error("Lost parent node!");
+
+		if (fileExists(formatFileName("closed", exitSearchFrameGroup)))
+		{
+			printTime();
+			printf("Backward frame" GROUP_STR " " GROUP_FORMAT "... \n", exitSearchFrameGroup);
+
+			if (findExitParent<true>())
+			{
+				printTime(); printf("Found (at %d)!          \n", exitSearchStateParentFrame);
+				steps[stepNr++]      = exitSearchStateStep;
+				exitSearchState      = exitSearchStateParent;
+				exitSearchStateFrame = exitSearchStateParentFrame;
+#ifdef TRACE_LAST_ACTION
+				exitSearchStateAction = exitSearchStateParentAction;
+#endif
+			}
+		}
+	}
+	return stepNr;
+}
+
+int bidirectionalSearch()
+{
+	int stages[2];
+
+	switchSearchSide(SEARCH_SIDE_BACKWARD);
+	stages[SEARCH_SIDE_BACKWARD] = searchResume(finishStates, finishStateCount);
+	switchSearchSide(SEARCH_SIDE_FORWARD);
+	stages[SEARCH_SIDE_FORWARD ] = searchResume(initialStates, initialStateCount);
+
+	if (fileExists(formatFileName("meeting")))
+		loadMeeting();
+	else
+	{
+		meeting.found = false;
+		meeting.joinedFrameGroups[SEARCH_SIDE_FORWARD] = meeting.joinedFrameGroups[SEARCH_SIDE_BACKWARD] = -1;
+	}
+
+	while (true)
+	{
+		for (int side=SEARCH_SIDE_FORWARD; side<=SEARCH_SIDE_BACKWARD; side++)
+			if (meeting.joinedFrameGroups[side] < searchSides[side].currentFrameGroup && stages[side] == SEARCH_STAGE_EXPANDING)
+			{
+				switchSearchSide(side);
+				bidirectionalJoin();
+			}
+
+		if (bidirectionalMeetingIsOptimal())
+			break;
+
+		// Advance the side that is in the middle of a frame group, otherwise the one with the smaller frontier.
+		int side;
+		if (stages[SEARCH_SIDE_FORWARD] != SEARCH_STAGE_EXPANDING)
+			side = SEARCH_SIDE_FORWARD;
+		else
+		if (stages[SEARCH_SIDE_BACKWARD] != SEARCH_STAGE_EXPANDING)
+			side = SEARCH_SIDE_BACKWARD;
+		else
+		if (searchSides[SEARCH_SIDE_FORWARD].currentFrameGroup + searchSides[SEARCH_SIDE_BACKWARD].currentFrameGroup >= maxFrameGroups)
+		{
+			// The frame group limit applies to the depth of both searches together.
+			printf("Exit not found.\n");
+			return EXIT_NOTFOUND;
+		}
+		else
+			side = searchSides[SEARCH_SIDE_FORWARD].closedNodesInCurrentFrameGroup <= searchSides[SEARCH_SIDE_BACKWARD].closedNodesInCurrentFrameGroup ? SEARCH_SIDE_FORWARD : SEARCH_SIDE_BACKWARD;
+
+		switchSearchSide(side);
+		int result = searchFrameGroups(stages[side], true);
+		stages[side] = SEARCH_STAGE_EXPANDING;
+		if (result != SEARCH_CONTINUE)
+			return result;
+	}
+
+	printTime();
+	printf("Searches met (at frame %u, %u frames from the finish), tracing path...\n", meeting.frames[SEARCH_SIDE_FORWARD], meeting.frames[SEARCH_SIDE_BACKWARD]);
+
+	Step steps[MAX_STEPS];
+	switchSearchSide(SEARCH_SIDE_BACKWARD);
+	int stepNr = traceBackward(steps);
+
+	switchSearchSide(SEARCH_SIDE_FORWARD);
+	State meetingState;
+	meetingState.decompress(&meeting.state);
+	traceExit(&meetingState, meeting.frames[SEARCH_SIDE_FORWARD], steps, stepNr);
+	return EXIT_OK;
+}
+
+#endif // BIDIRECTIONAL_SEARCH
+
+int search()
+{
+	if (fileExists(formatProblemFileName(NULL, NULL, "txt")))
+	{
+		printf("Solution already found.\n");
+		return EXIT_OK;
+	}
+
+	if (fileExists(formatFileName("solution")))
+	{
+		printf("Partial trace solution file present, resuming exit trace...\n");
+		traceExit(NULL, 0);
+		return EXIT_OK;
+	}
+
+#ifdef USE_GOAL_SET
+	enforce(fileExists(formatFileName("goals")), format("Goal set file (%s) not found", formatFileName("goals")));
 #endif
 
-		timeb time4;
-		ftime(&time4);
-		{
-			time_t ms         = (time4.time - time3.time)*1000 + (time4.millitm - time3.millitm);
-			time_t ms_total   = (time4.time - time1.time)*1000 + (time4.millitm - time1.millitm);
-#ifdef PRINT_RUNNING_TOTAL_TIME
-			time_t ms_running = (time4.time - time0.time)*1000 + (time4.millitm - time0.millitm);
-			printf("%4d.%03d s (%4d.%03d s, %6d.%03d s)", ms/1000, ms%1000, ms_total/1000, ms_total%1000, ms_running/1000, ms_running%1000);
+	ftime(&searchStartTime);
+
+#ifdef BIDIRECTIONAL_SEARCH
+	return bidirectionalSearch();
 #else
-			printf("%4d.%03d s (%4d.%03d s)", ms/1000, ms%1000, ms_total/1000, ms_total%1000);
+	return searchFrameGroups(searchResume(initialStates, initialStateCount), false);
 #endif
-		}
-		time1 = time4;
-
-		putchar('\n');
-	}
-	
-	printf("Exit not found.\n");
-	return EXIT_NOTFOUND;
 }
 
-#if 0
-// ******************************************* Grouped-search *******************************************
 
-int groupedSearch(FRAME_GROUP groupSize, bool filterFirst)
-{
-	firstFrameGroup = 0;
+// ****************************************** Pattern database ******************************************
 
-	if (fileExists(formatFileName("solution")))
-		error(format("Partial trace solution file (%s) present - if you want to resume exit tracing, run \"search\" instead, otherwise delete the file", formatFileName("solution")));
+#ifdef HAVE_PATTERN_DATABASE
 
-	for (FRAME_GROUP g=MAX_FRAME_GROUPS; g>=0; g--)
-		if (fileExists(formatFileName("closed", g)))
-		{
-			printf("Resuming from frame" GROUP_STR " " GROUP_FORMAT "\n", g+1);
-			firstFrameGroup = g+1;
-			break;
-	    }
+#ifndef MAX_FRAME_DELAY
+#error HAVE_PATTERN_DATABASE requires the problem to define MAX_FRAME_DELAY
+#endif
 
-	if (firstFrameGroup==0)
-		error("No closed node files found");
+/// Runs a backward search over the abstract state space (State::abstract), starting from the abstracted finish states,
+/// then collects the distances from the closed node files into a table indexed by State::patternIndex().
+int buildPatternDatabase()
+{
+	if (fileExists(formatFileName("pdb")))
+	{
+		printf("Pattern database already built.\n");
+		return EXIT_OK;
+	}
 
-	for (FRAME_GROUP g=firstFrameGroup; g<MAX_FRAME_GROUPS; g++)
-		if (fileExists(formatFileName("open", g)))
-		{
-			printTime(); printf("Reopening queue for frame" GROUP_STR " " GROUP_FORMAT "\n", g);
-			queue[g] = new BufferedOutputStream(formatFileName("open", g), true, 0);
-		}
+	searchFileNamePrefix = "pdb-";
+	searchBackward = true;
+	searchAbstract = true;
 
-	FRAME_GROUP baseFrameGroup = firstFrameGroup;
+	State abstractFinishStates[MAX_FINISH_STATES];
+	for (int i=0; i<finishStateCount; i++)
+	{
+		abstractFinishStates[i] = finishStates[i];
+		abstractFinishStates[i].abstract();
+	}
 
-	while (true)
+	ftime(&searchStartTime);
+	int stage = searchResume(abstractFinishStates, finishStateCount);
+	int emptyFrameGroups = 0;
+	// Every node that is still open is at most MAX_FRAME_DELAY frames past the last closed one.
+	while (emptyFrameGroups * FRAMES_PER_GROUP < MAX_FRAME_DELAY)
 	{
-		bool haveOpen = false;
-		for (FRAME_GROUP g=baseFrameGroup; g<MAX_FRAME_GROUPS; g++)
-			if (fileExists(formatFileName("open", g)))
+		int result = searchFrameGroups(stage, true);
+		if (result == EXIT_NOTFOUND)
+			break;
+		if (result != SEARCH_CONTINUE)
+			return result;
+		stage = SEARCH_STAGE_EXPANDING;
+		emptyFrameGroups = closedNodesInCurrentFrameGroup ? 0 : emptyFrameGroups + 1;
+	}
+	FRAME_GROUP lastFrameGroup = currentFrameGroup;
+
+	// Build the table in RAM-sized slices, scanning all closed node files for each slice.
+	RamArenas arenas;
+	const uint64_t sliceSize = arenas.remaining<PATTERN_DATABASE_ENTRY>();
+	PATTERN_DATABASE_ENTRY* slice = arenas.allocate<PATTERN_DATABASE_ENTRY>("pattern database", (size_t)sliceSize);
+	OutputStream<PATTERN_DATABASE_ENTRY> output(formatFileName("pdb-building"), false);
+	for (uint64_t sliceStart=0; sliceStart<PATTERN_DATABASE_SIZE; sliceStart+=sliceSize)
+	{
+		uint64_t sliceEnd = min<uint64_t>(sliceStart + sliceSize, PATTERN_DATABASE_SIZE);
+		printTime(); printf("Writing pattern database entries %llu-%llu...\n", (unsigned long long)sliceStart, (unsigned long long)sliceEnd);
+		memset(slice, PATTERN_DATABASE_UNREACHABLE, (size_t)(sliceEnd - sliceStart) * sizeof(PATTERN_DATABASE_ENTRY));
+
+		for (FRAME_GROUP g=0; g<=lastFrameGroup; g++)
+			if (fileExists(formatFileName("closed", g)))
 			{
-				haveOpen = true;
-				break;
+				BufferedInputStream<Node> input(formatFileName("closed", g));
+				const Node* cs;
+				while (cs = input.read())
+				{
+					State state;
+					state.decompress(&cs->getState());
+					uint64_t index = state.patternIndex();
+					if (index < sliceStart || index >= sliceEnd)
+						continue;
+					FRAME frame = GET_FRAME(g, *cs);
+					PATTERN_DATABASE_ENTRY distance = frame < PATTERN_DATABASE_UNREACHABLE ? (PATTERN_DATABASE_ENTRY)frame : PATTERN_DATABASE_UNREACHABLE-1;
+					if (slice[index - sliceStart] > distance)
+						slice[index - sliceStart] = distance;
+				}
 			}
-		if (!haveOpen)
-			break;
 
-		printTime(); printf("=== Frame"GROUP_STR"s "GROUP_FORMAT" .. "GROUP_FORMAT" ===\n", baseFrameGroup, baseFrameGroup+groupSize-1);
+		output.write(slice, (size_t)(sliceEnd - sliceStart));
+	}
+	output.close();
+	renameFile(formatFileName("pdb-building"), formatFileName("pdb"));
 
-		if (filterFirst)
-		{
-			for (FRAME_GROUP g=baseFrameGroup; g<baseFrameGroup+groupSize; g++)
-				if (queue[g])
-				{
-					delete queue[g];
-					queue[g] = NULL;
-				}
+	printTime(); printf("Pattern database built.\n");
+	return EXIT_OK;
+}
 
-			printTime(); printf("Sorting...\n");
-			doSortOpen(baseFrameGroup, baseFrameGroup+groupSize);
-			if (checkStop()) return EXIT_STOP;
+#endif // HAVE_PATTERN_DATABASE
 
-			printTime(); printf("Filtering...\n");
-			doFilterOpen(baseFrameGroup, baseFrameGroup+groupSize);
-			if (checkStop()) return EXIT_STOP;
-		}
+#ifndef BIDIRECTIONAL_SEARCH
+// ******************************************* Grouped-search *******************************************
 
-		for (FRAME_GROUP g=baseFrameGroup; g<baseFrameGroup+groupSize; g++)
-			if (!queue[g] && fileExists(formatFileName("open", g)))
-			{
-				//printTime(); printf("Reopening queue for frame" GROUP_STR " " GROUP_FORMAT "\n", g);
-				queue[g] = new BufferedOutputStream(formatFileName("open", g), true, 0);
-			}
+/// Runs the search in batches of batchSize frame groups. Each frame group is expanded and combined against a "batchcombined"
+/// node file holding only the nodes of the batch, and the combined node file is rewritten once at the end of the batch.
+int groupedSearch(FRAME_GROUP batchSize)
+{
+	enforce(batchSize > 0, "The batch size must be positive");
+	searchBatchSize = batchSize;
+	return search();
+}
+#endif
 
-		prepareOpen();
-		
-		for (currentFrameGroup=baseFrameGroup; currentFrameGroup<baseFrameGroup+groupSize; currentFrameGroup++)
-		{
-			if (!queue[currentFrameGroup])
-				continue;
-			delete queue[currentFrameGroup];
-			queue[currentFrameGroup] = NULL;
+// ******************************************** Parallel scan *******************************************
 
-			printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT ": ", currentFrameGroup); fflush(stdout);
-			ramUsed = 0;
-			sortAndMerge(currentFrameGroup);
+// The offline modes below read whole node files. parallelScan splits a file into one range per worker, runs a copy of a
+// scanner object over each range on its own thread, and then folds the copies' results together in file order.
+// A scanner class provides:
+//   void scan(BufferedSplitInputStream<NODE>* input, uint64_t start, uint64_t end, const NODE* previous)
+//     Processes the nodes from position start to end. "previous" is the node before the range (NULL for the first range),
+//     for checks which compare adjacent nodes.
+//   void reduce(const SCANNER* next)
+//     Adds the results of the range following this one.
 
-			printf("Clearing... "); fflush(stdout);
-			memset(ram, 0, ramUsed); // clear cache
+template<class NODE, class SCANNER>
+struct ParallelScan
+{
+	static char filename[1024];
+	static uint64_t size;
+	static unsigned ranges;
+	static SCANNER* scanners;
+};
 
-			printf("Expanding... "); fflush(stdout);
-#ifdef MULTITHREADING
-			startWorkers<&processState>();
-#endif
-			BufferedInputStream input(formatFileName("merged", currentFrameGroup));
-			const CompressedState* cs;
-			while (cs = input.read())
-				processFilteredState(cs);
-#ifdef MULTITHREADING
-			flushProcessingQueue();
-#endif
-			printf("Done.\n");
+template<class NODE, class SCANNER> char ParallelScan<NODE, SCANNER>::filename[1024];
+template<class NODE, class SCANNER> uint64_t ParallelScan<NODE, SCANNER>::size;
+template<class NODE, class SCANNER> unsigned ParallelScan<NODE, SCANNER>::ranges;
+template<class NODE, class SCANNER> SCANNER* ParallelScan<NODE, SCANNER>::scanners;
 
-			if (exitFound)
-			{
-				assert(currentFrameGroup == exitFrame / FRAMES_PER_GROUP);
-				printf("Exit has been found, stopping.\n");
-				break;
-			}
-		}
+template<class NODE, class SCANNER>
+void parallelScanRange(unsigned range)
+{
+	typedef ParallelScan<NODE, SCANNER> Scan;
+	uint64_t start = Scan::size *  range    / Scan::ranges;
+	uint64_t end   = Scan::size * (range+1) / Scan::ranges;
+	NODE previous;
+	if (start)
+	{
+		InputStream<NODE> input(Scan::filename);
+		input.seek(start-1);
+		input.read(&previous, 1);
+	}
+	BufferedSplitInputStream<NODE> input(Scan::filename, start, end);
+	Scan::scanners[range].scan(&input, start, end, start ? &previous : NULL);
+}
 
-		printTime(); printf("Flushing...\n");
-		flushOpen();
+#ifdef MULTITHREADING
+template<class NODE, class SCANNER>
+void parallelScanWorker()
+{
+	parallelScanRange<NODE, SCANNER>(TLS_GET_THREAD_ID);
 
-		for (FRAME_GROUP g=baseFrameGroup; g<baseFrameGroup+groupSize; g++)
-			if (queue[g])
-			{
-				delete queue[g];
-				queue[g] = NULL;
-			}
+	SCOPED_LOCK lock(processQueueMutex);
+	runningWorkers--;
+	CONDITION_NOTIFY(processQueueExitCondition, lock);
+}
+#endif
 
-		printTime(); printf("Filtering...\n");
-		BufferedRewriteStream* merged = new BufferedRewriteStream[groupSize];
-		for (int g=0; g<groupSize; g++)
-			if (fileExists(formatFileName("merged", baseFrameGroup+g)))
-			{
-				//merged[g].setReadBufferSize(MERGING_BUFFER_SIZE);
-				//merged[g].setWriteBufferSize(MERGING_BUFFER_SIZE);
-				merged[g].open(formatFileName("merged", baseFrameGroup+g));
-			}
-#ifdef USE_ALL
-		filterAgainstClosed<true >(merged, groupSize);
+/// Runs copies of *scanner over at most maxRanges ranges of the given sorted node file, and folds their results into *scanner.
+template<class NODE, class SCANNER>
+void parallelScan(const char* filename, SCANNER* scanner, unsigned maxRanges=UINT_MAX)
+{
+	typedef ParallelScan<NODE, SCANNER> Scan;
+	strcpy(Scan::filename, filename);
+	{
+		InputStream<NODE> getSize(filename);
+		Scan::size = getSize.size();
+	}
+#ifdef MULTITHREADING
+	Scan::ranges = WORKERS;
 #else
-		filterAgainstClosed<false>(merged, groupSize);
+	Scan::ranges = 1;
 #endif
-		delete[] merged;
+	if (Scan::ranges > maxRanges)
+		Scan::ranges = maxRanges;
+	if (Scan::ranges > Scan::size)
+		Scan::ranges = Scan::size ? (unsigned)Scan::size : 1;
 
-		for (FRAME_GROUP g=baseFrameGroup; g<baseFrameGroup+groupSize; g++)
-			if (fileExists(formatFileName("merged", g)))
-			{
-				deleteFile(formatFileName("open", g));
-				renameFile(formatFileName("merged", g), formatFileName("closed", g));
-			}
+	Scan::scanners = new SCANNER[Scan::ranges];
+	for (unsigned i=0; i<Scan::ranges; i++)
+		Scan::scanners[i] = *scanner;
 
-		if (exitFound)
+#ifdef MULTITHREADING
+	if (Scan::ranges > 1)
+	{
 		{
-			putchar('\n');
-			printTime();
-			printf("Exit found (at frame %u), tracing path...\n", exitFrame);
-			traceExit(&exitState, exitFrame);
-			return EXIT_OK;
+			SCOPED_LOCK lock(processQueueMutex);
+			runningWorkers += Scan::ranges;
 		}
+		for (THREAD_ID threadID=0; threadID<Scan::ranges; threadID++)
+			THREAD_CREATE<parallelScanWorker<NODE, SCANNER>>(threadID);
+		flushProcessingQueue();
+	}
+	else
+#endif
+		parallelScanRange<NODE, SCANNER>(0);
 
-		baseFrameGroup += groupSize;
+	*scanner = Scan::scanners[0];
+	for (unsigned i=1; i<Scan::ranges; i++)
+		scanner->reduce(&Scan::scanners[i]);
+	delete[] Scan::scanners;
+}
 
-		if (checkStop())
-			return EXIT_STOP;
+/// Returns the position of the first node in the sorted file which is not less than *key.
+template<class NODE>
+uint64_t findLowerBound(InputStream<NODE>* input, const NODE* key)
+{
+	uint64_t low = 0, high = input->size();
+	while (low < high)
+	{
+		uint64_t mid = low + (high-low) / 2;
+		NODE node;
+		input->seek(mid);
+		input->read(&node, 1);
+		if (node < *key)
+			low = mid+1;
+		else
+			high = mid;
 	}
-	printf("Exit not found.\n");
-	return EXIT_NOTFOUND;
+	return low;
 }
-#endif
 
-#if 0
-// ********************************************* Pack-open **********************************************
+// ************************************************ Dump ************************************************
 
-int packOpen()
-{
-	for (FRAME_GROUP g=firstFrameGroup; g<maxFrameGroups; g++)
-    	if (fileExists(formatFileName("open", g)))
-    	{
-			printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT ": ", g);
+#ifdef MULTITHREADING
+MUTEX dumpMutex; // State::toString isn't required to be thread-safe
+#endif
 
-			{
-				InputStream input(formatFileName("open", g));
-				OutputStream output(formatFileName("openpacked", g));
-				uint64_t amount = input.size();
-				if (amount > BUFFER_SIZE)
-					amount = BUFFER_SIZE;
-				size_t records;
-				uint64_t read=0, written=0;
-				while (records = input.read(buffer, (size_t)amount))
-				{
-					read += records;
-					std::sort(buffer, buffer + records);
-					records = deduplicate(buffer, records);
-					written += records;
-					output.write(buffer, records);
-				}
-				output.flush();
+/// Writes the states of its range to stdout (first range) or to a temporary file, which reduce copies to stdout in order.
+class DumpScanner
+{
+public:
+	FRAME_GROUP g;
+	FILE* output;
 
-				if (read == written)
-					printf("No improvement.\n");
-				else
-					printf("%llu -> %llu.\n", read, written);
-			}
-			deleteFile(formatFileName("open", g));
-			renameFile(formatFileName("openpacked", g), formatFileName("open", g));
-    	}
-	return EXIT_OK;
-}
+	void scan(BufferedSplitInputStream<Node>* input, uint64_t start, uint64_t end, const Node* previous)
+	{
+		output = start ? tmpfile() : stdout;
+		enforce(output, "Can't create temporary file");
+		const Node* cs;
+		while (cs = input->read())
+		{
+			State s;
+			s.decompress(&cs->getState());
+#ifdef MULTITHREADING
+			SCOPED_LOCK lock(dumpMutex);
+#endif
+#ifdef GROUP_FRAMES
+			fprintf(output, "Frame %u:\n", GET_FRAME(g, *cs));
 #endif
+			fputs(s.toString(), output);
+			fputc('\n', output);
+		}
+	}
 
-// ************************************************ Dump ************************************************
+	void reduce(const DumpScanner* next)
+	{
+		char buf[0x10000];
+		size_t n;
+		rewind(next->output);
+		while (n = fread(buf, 1, sizeof(buf), next->output))
+			enforce(fwrite(buf, 1, n, stdout) == n, "Error writing to standard output");
+		enforce(!ferror(next->output), "Error reading temporary file");
+		fclose(next->output);
+	}
+};
 
 int dump(FRAME_GROUP g)
 {
@@ -4012,17 +5888,9 @@ int dump(FRAME_GROUP g)
 	if (!fileExists(fn))
 		error(format("Can't find neither open nor closed node file for frame" GROUP_STR " " GROUP_FORMAT, g));
 	
-	BufferedInputStream<Node> in(fn);
-	const Node* cs;
-	while (cs = in.read())
-	{
-#ifdef GROUP_FRAMES
-		printf("Frame %u:\n", GET_FRAME(g, *cs));
-#endif
-		State s;
-		s.decompress(&cs->getState());
-		puts(s.toString());
-	}
+	DumpScanner scanner;
+	scanner.g = g;
+	parallelScan<Node>(fn, &scanner);
 	return EXIT_OK;
 }
 
@@ -4056,38 +5924,107 @@ int sample(FRAME_GROUP g, unsigned count)
 
 // ********************************************** Compare ***********************************************
 
-int compare(const char* fn1, const char* fn2)
+// Each range of the first file is joined against the nodes of the second file which sort between the range's first node and the
+// next range's. Ranges only count the interweaves inside them; reduce() adds the ones at the range boundaries.
+
+class CompareScanner
 {
-	BufferedInputStream<Node> i1(fn1), i2(fn2);
-	printf("%s: %llu states\n%s: %llu states\n", fn1, i1.size(), fn2, i2.size());
-	const Node *cs1, *cs2;
-	cs1 = i1.read();
-	cs2 = i2.read();
-	uint64_t dups = 0;
-	uint64_t switches = 0;
-	int last=0, cur;
-	while (cs1 && cs2)
-	{
-		if (*cs1 < *cs2)
-			cs1 = i1.read(),
-			cur = -1;
-		else
-		if (*cs1 > *cs2)
-			cs2 = i2.read(),
-			cur = 1;
-		else
+public:
+	const char *fn1, *fn2;
+	uint64_t size1, size2;
+	uint64_t dups, switches;
+	int first, last; // which file advanced first and last in this range (-1 = first file, 1 = second file, 0 = both)
+
+	void scan(BufferedSplitInputStream<Node>* i1, uint64_t start, uint64_t end, const Node* previous)
+	{
+		uint64_t start2, end2;
+		{
+			InputStream<Node> input(fn2);
+			InputStream<Node> input1(fn1);
+			Node key;
+			if (start)
+			{
+				input1.seek(start);
+				input1.read(&key, 1);
+				start2 = findLowerBound(&input, &key);
+			}
+			else
+				start2 = 0;
+			if (end < size1)
+			{
+				input1.seek(end);
+				input1.read(&key, 1);
+				end2 = findLowerBound(&input, &key);
+			}
+			else
+				end2 = size2;
+		}
+		BufferedSplitInputStream<Node> i2(fn2, start2, end2);
+
+		// When one side of a range runs out, the comparison continues against the other file's next range, if there is one.
+		bool more1 = end < size1, more2 = end2 < size2;
+
+		dups = switches = 0;
+		first = last = start ? 2 : 0; // the first range starts as the whole-file comparison does
+		const Node *cs1, *cs2;
+		cs1 = i1->read();
+		cs2 = i2.read();
+		while ((cs1 || more1) && (cs2 || more2) && (cs1 || cs2))
 		{
-			dups++;
-			cs1 = i1.read();
-			cs2 = i2.read();
-			cur = 0;
+			int cur;
+			if (cs1 && (!cs2 || *cs1 < *cs2))
+				cs1 = i1->read(),
+				cur = -1;
+			else
+			if (!cs1 || *cs1 > *cs2)
+				cs2 = i2.read(),
+				cur = 1;
+			else
+			{
+				dups++;
+				cs1 = i1->read();
+				cs2 = i2.read();
+				cur = 0;
+			}
+			if (first == 2)
+				first = cur;
+			else
+			if (cur != last)
+				switches++;
+			last = cur;
+		}
+	}
+
+	void reduce(const CompareScanner* next)
+	{
+		dups += next->dups;
+		switches += next->switches;
+		if (next->first != 2)
+		{
+			if (next->first != last)
+				switches++;
+			last = next->last;
 		}
-		if (cur != last)
-			switches++;
-		last = cur;
 	}
-	printf("%llu duplicate states\n", dups);
-	printf("%llu interweaves\n", switches);
+};
+
+int compare(const char* fn1, const char* fn2)
+{
+	CompareScanner scanner;
+	{
+		InputStream<Node> i1(fn1), i2(fn2);
+		scanner.size1 = i1.size();
+		scanner.size2 = i2.size();
+	}
+	printf("%s: %llu states\n%s: %llu states\n", fn1, scanner.size1, fn2, scanner.size2);
+	char fn1copy[1024], fn2copy[1024]; // the format() buffers are shared between threads
+	strcpy(fn1copy, fn1);
+	strcpy(fn2copy, fn2);
+	scanner.fn1 = fn1copy;
+	scanner.fn2 = fn2copy;
+	parallelScan<Node>(fn1, &scanner);
+	printf("%llu duplicate states\n", scanner.dups);
+	printf("%llu interweaves\n", scanner.switches);
 	return EXIT_OK;
 }
 
@@ -4201,20 +6138,37 @@ int unpack()
 
 // *********************************************** Count ************************************************
 
+class CountScanner
+{
+public:
+	uint64_t counts[FRAMES_PER_GROUP];
+
+	void scan(BufferedSplitInputStream<Node>* input, uint64_t start, uint64_t end, const Node* previous)
+	{
+		const Node* cs;
+		while (cs = input->read())
+			counts[cs->subframe]++;
+	}
+
+	void reduce(const CountScanner* next)
+	{
+		for (int i=0; i<FRAMES_PER_GROUP; i++)
+			counts[i] += next->counts[i];
+	}
+};
+
 int count()
 {
 	for (FRAME_GROUP g=firstFrameGroup; g<maxFrameGroups; g++)
 		if (fileExists(formatFileName("closed", g)))
 		{
 			printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT ":\n", g);
-			BufferedInputStream<Node> input(formatFileName("closed", g));
-			const Node* cs;
-			uint64_t counts[FRAMES_PER_GROUP] = {0};
-			while (cs = input.read())
-				counts[cs->subframe]++;
+			CountScanner scanner;
+			memset(scanner.counts, 0, sizeof(scanner.counts));
+			parallelScan<Node>(formatFileName("closed", g), &scanner);
 			for (int i=0; i<FRAMES_PER_GROUP; i++)
-				if (counts[i])
-					printf("Frame %u: %llu\n", g*FRAMES_PER_GROUP+i, counts[i]);
+				if (scanner.counts[i])
+					printf("Frame %u: %llu\n", g*FRAMES_PER_GROUP+i, scanner.counts[i]);
 			fflush(stdout);
 		}
 	return EXIT_OK;
@@ -4224,336 +6178,694 @@ int count()
 
 // *********************************************** Verify ***********************************************
 
+/// Finds the first position of a node which is equal to or less than the node before it.
+class VerifyScanner
+{
+public:
+	static const uint64_t NOT_FOUND = ~0ULL;
+	uint64_t equalPos, oooPos;
+	bool badSubframe;
+
+	void scan(BufferedSplitInputStream<Node>* input, uint64_t start, uint64_t end, const Node* previous)
+	{
+		Node cs = previous ? *previous : Node(); // only compared from the second node of the file
+		uint64_t pos = start;
+		const Node* cs2;
+		for (; cs2 = input->read(); pos++)
+		{
+#ifdef GROUP_FRAMES
+			if (cs2->subframe >= FRAMES_PER_GROUP)
+				badSubframe = true;
+#endif
+			if (pos)
+			{
+				if (cs == *cs2 && equalPos == NOT_FOUND)
+					equalPos = pos;
+				if (cs > *cs2 && oooPos == NOT_FOUND)
+					oooPos = pos;
+			}
+			cs = *cs2;
+		}
+	}
+
+	void reduce(const VerifyScanner* next)
+	{
+		if (equalPos == NOT_FOUND)
+			equalPos = next->equalPos;
+		if (oooPos == NOT_FOUND)
+			oooPos = next->oooPos;
+		badSubframe |= next->badSubframe;
+	}
+};
+
 int verify(const char* filename)
 {
-	BufferedInputStream<Node> input(filename);
-	Node cs = *input.read();
-	bool equalFound=false, oooFound=false;
-	uint64_t pos = 0;
-	while (1)
+	VerifyScanner scanner;
+	scanner.equalPos = scanner.oooPos = VerifyScanner::NOT_FOUND;
+	scanner.badSubframe = false;
+	parallelScan<Node>(filename, &scanner);
+	if (scanner.badSubframe)
+		error("Invalid subframe (corrupted data?)");
+	if (scanner.equalPos != VerifyScanner::NOT_FOUND)
+		printf("Equal states found: %lld\n", scanner.equalPos);
+	if (scanner.oooPos != VerifyScanner::NOT_FOUND)
+		printf("Unordered states found: %lld\n", scanner.oooPos);
+	return EXIT_OK;
+}
+
+// ********************************************* Find-exit **********************************************
+
+/// Finds the finish node with the lowest frame (and position) in a closed or open node file.
+class FindExitScanner
+{
+public:
+	FRAME_GROUP g;
+	bool found;
+	FRAME frame;
+	uint64_t position;
+	CompressedState state;
+
+	void scan(BufferedSplitInputStream<Node>* input, uint64_t start, uint64_t end, const Node* previous)
 	{
-		const Node* cs2 = input.read();
-		pos++;
-		if (cs2==NULL)
-			return EXIT_OK;
-		if (cs == *cs2)
-			if (!equalFound)
+		const Node* cs;
+		for (uint64_t pos=start; cs = input->read(); pos++)
+		{
+			FRAME f = GET_FRAME(g, *cs);
+			if (found && frame <= f)
+				continue;
+			State s;
+			s.decompress(&cs->getState());
+			if (s.isFinish())
 			{
-				printf("Equal states found: %lld\n", pos);
-				equalFound = true;
+				found = true;
+				frame = f;
+				position = pos;
+				state = cs->getState();
 			}
-		if (cs > *cs2)
-			if (!oooFound)
+		}
+	}
+
+	void reduce(const FindExitScanner* next)
+	{
+		if (next->found && (!found || next->frame < frame))
+		{
+			found = true;
+			frame = next->frame;
+			position = next->position;
+			state = next->state;
+		}
+	}
+};
+
+int findExit()
+{
+	if (fileExists(formatFileName("solution")))
+		error(format("Partial trace solution file (%s) present - if you want to resume exit tracing, run \"search\" instead, otherwise delete the file", formatFileName("solution")));
+	
+	// redeclare currentFrameGroup
+	for (FRAME_GROUP currentFrameGroup=firstFrameGroup; currentFrameGroup<maxFrameGroups; currentFrameGroup++)
+	{
+		const char* fn = formatFileName("closed", currentFrameGroup);
+		if (!fileExists(fn))
+			fn = formatFileName("open", currentFrameGroup);
+		if (fileExists(fn))
+		{
+			printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT "/" GROUP_FORMAT ": ", currentFrameGroup, maxFrameGroups); fflush(stdout);
+			FindExitScanner scanner;
+			scanner.g = currentFrameGroup;
+			scanner.found = false;
+			parallelScan<Node>(fn, &scanner);
+			if (scanner.found)
 			{
-				printf("Unordered states found: %lld\n", pos);
-				oooFound = true;
+				State s;
+				s.decompress(&scanner.state);
+				printTime();
+				printf("Exit found (at frame %u), tracing path...\n", scanner.frame);
+				traceExit(&s, scanner.frame);
+				return EXIT_OK;
 			}
-#ifdef GROUP_FRAMES
-		if (cs2->subframe >= FRAMES_PER_GROUP)
-			error("Invalid subframe (corrupted data?)");
-#endif
-		cs = *cs2;
-		if (equalFound && oooFound)
-			return EXIT_OK;
+			printf("Done.\n");
+		}
 	}
+	printf("Exit not found.\n");
+	return EXIT_NOTFOUND;
 }
 
-#if 0
-// ********************************************* Sort-open **********************************************
 
-int doSortOpen(FRAME_GROUP firstFrameGroup, FRAME_GROUP maxFrameGroups)
+// ******************************************** Trace-all *********************************************
+
+#if !defined(BIDIRECTIONAL_SEARCH) && !defined(USE_TRANSFORM_INVARIANT_SORTING)
+
+/// A node which lies on an optimal path, with the number of optimal paths leading from it to a finish state.
+struct SolutionNode
+{
+	CompressedState state;
+	FRAME frame;
+	uint64_t paths;
+};
+
+INLINE bool operator<(const SolutionNode& a, const SolutionNode& b) { return a.state < b.state; }
+
+/// An edge of the solution DAG, as written to the "solutions" file.
+struct SolutionEdge
+{
+	CompressedState parent;
+	FRAME parentFrame;
+	Step step;
+	CompressedState child;
+	FRAME childFrame;
+};
+
+std::vector<SolutionNode> solutionWindow; // nodes of the frame groups already traced which can still have parents, sorted by state
+std::vector<SolutionNode> solutionGroup; // nodes of the frame group being traced, sorted by state
+std::vector<SolutionNode> solutionNewNodes; // parents found in the current pass
+std::vector<SolutionEdge> solutionGroupEdges; // edges found in the frame group being traced
+const SolutionNode *solutionTargetsBegin, *solutionTargetsEnd; // the nodes whose parents the current pass looks for
+
+/// Records the steps which lead from the expanded node to one of the target nodes.
+class SolutionParentHandler
 {
-	// override global variables
-	for (FRAME_GROUP currentFrameGroup=maxFrameGroups-1; currentFrameGroup>=firstFrameGroup; currentFrameGroup--)
+public:
+	enum { PREFERRED = PREFERRED_STATE_COMPRESSED };
+
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const State* state, FRAME frame)
 	{
-		if (!fileExists(formatFileName("open", currentFrameGroup)))
-			continue;
-		if (fileExists(formatFileName("merged", currentFrameGroup)))
-			error("Merged file present");
-		uint64_t initialSize, finalSize;
-		{
-			InputStream s(formatFileName("open", currentFrameGroup));
-			initialSize = s.size();
-		}
-		if (initialSize==0)
-			continue;
+		CompressedState cs;
+		state->compress(&cs);
+		handleChild(parent, parentFrame, step, &cs, frame);
+	}
 
-		printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT "/" GROUP_FORMAT ": ", currentFrameGroup, maxFrameGroups); fflush(stdout);
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const CompressedState* cs, FRAME frame)
+	{
+		SolutionNode key;
+		key.state = *cs;
+		const SolutionNode* target = std::lower_bound(solutionTargetsBegin, solutionTargetsEnd, key);
+		if (target == solutionTargetsEnd || target->state != *cs || target->frame != frame)
+			return;
 
-		sortAndMerge(currentFrameGroup);
-		
-		deleteFile(formatFileName("open", currentFrameGroup));
-		renameFile(formatFileName("merged", currentFrameGroup), formatFileName("open", currentFrameGroup));
+		SolutionEdge edge;
+		parent->compress(&edge.parent);
+		edge.parentFrame = parentFrame;
+		edge.step        = step;
+		edge.child       = *cs;
+		edge.childFrame  = frame;
+		solutionGroupEdges.push_back(edge);
 
+		if (solutionNewNodes.empty() || solutionNewNodes.back().state != edge.parent) // a node's children are enumerated together
 		{
-			InputStream s(formatFileName("open", currentFrameGroup));
-			finalSize = s.size();
+			SolutionNode node;
+			node.state = edge.parent;
+			node.frame = parentFrame;
+			node.paths = 0;
+			solutionNewNodes.push_back(node);
 		}
+	}
+};
+
+/// Collects the finish nodes with the lowest frame in the closed node file for frame group g into nodes. Returns false if there are none.
+bool findSolutionFinishNodes(FRAME_GROUP g, std::vector<SolutionNode>& nodes)
+{
+	BufferedInputStream<Node> input(formatFileName("closed", g));
+#ifdef USE_GOAL_SET
+	BufferedInputStream<Node> goals(formatFileName("goals"));
+	const Node* goal = goals.read();
+#endif
+	const Node* cs;
+	while (cs = input.read())
+	{
+#ifdef USE_GOAL_SET
+		while (goal && *goal < *cs)
+			goal = goals.read();
+		if (!goal || *goal != *cs)
+			continue;
+#else
+		State s;
+		s.decompress(&cs->getState());
+		if (!s.isFinish())
+			continue;
+#endif
+		SolutionNode node;
+		node.state = cs->getState();
+		node.frame = GET_FRAME(g, *cs);
+		node.paths = 1;
+		if (!nodes.empty() && nodes[0].frame > node.frame)
+			nodes.clear();
+		if (nodes.empty() || nodes[0].frame == node.frame)
+			nodes.push_back(node);
+	}
+	return !nodes.empty();
+}
 
-		printf("Done: %lld -> %lld.\n", initialSize, finalSize);
+/// Expands the nodes of closed node file g once, recording the edges to the nodes in [solutionTargetsBegin, solutionTargetsEnd).
+/// Returns the number of parents not previously known, which are added to solutionGroup (and left in solutionNewNodes, sorted).
+size_t findSolutionParents(FRAME_GROUP g)
+{
+	FRAME lowestTargetFrame = MAX_FRAMES;
+	for (const SolutionNode* n = solutionTargetsBegin; n != solutionTargetsEnd; n++)
+		if (lowestTargetFrame > n->frame)
+			lowestTargetFrame = n->frame;
 
-		if (checkStop())
-			return EXIT_STOP;
+	solutionNewNodes.clear();
+	BufferedInputStream<Node> input(formatFileName("closed", g));
+	const Node* cs;
+	while (cs = input.read())
+	{
+		FRAME frame = GET_FRAME(g, *cs);
+		if (frame >= lowestTargetFrame || (ProblemTraits::maxFrameDelay && frame + ProblemTraits::maxFrameDelay < lowestTargetFrame))
+			continue;
+		State s;
+		s.decompress(&cs->getState());
+		expandChildren<SolutionParentHandler>(frame, &s);
 	}
-	return EXIT_OK;
+
+	// Nodes found again (as the parents of nodes from the previous pass over the same frame group) are already known.
+	std::vector<SolutionNode> added;
+	std::sort(solutionNewNodes.begin(), solutionNewNodes.end());
+	for (size_t i=0; i<solutionNewNodes.size(); i++)
+		if (!std::binary_search(solutionGroup.begin(), solutionGroup.end(), solutionNewNodes[i]))
+			added.push_back(solutionNewNodes[i]);
+	solutionNewNodes.swap(added);
+
+	size_t middle = solutionGroup.size();
+	solutionGroup.insert(solutionGroup.end(), solutionNewNodes.begin(), solutionNewNodes.end());
+	std::inplace_merge(solutionGroup.begin(), solutionGroup.begin() + middle, solutionGroup.end());
+	return solutionNewNodes.size();
 }
 
-int sortOpen()
+/// Returns the node with this state from the frame group being traced or from the window.
+SolutionNode* findSolutionNode(const CompressedState& state)
 {
-	return doSortOpen(firstFrameGroup, maxFrameGroups);
+	SolutionNode key;
+	key.state = state;
+	std::vector<SolutionNode>::iterator node = std::lower_bound(solutionGroup.begin(), solutionGroup.end(), key);
+	if (node == solutionGroup.end() || node->state != state)
+		node = std::lower_bound(solutionWindow.begin(), solutionWindow.end(), key);
+	return &*node;
 }
 
-// ****************************************** Seq-filter-open *******************************************
+INLINE bool solutionEdgeLater(const SolutionEdge& a, const SolutionEdge& b) { return a.parentFrame > b.parentFrame; }
 
-// Filters open node lists without expanding nodes.
-
-int seqFilterOpen()
+/// Finds all optimal solutions, by carrying the set of nodes that lie on an optimal path back through the closed node files.
+/// The edges between them are written to the "solutions" file one frame group at a time, and the number of optimal solutions is printed.
+/// Only the nodes which can still have parents in the remaining frame groups (according to MAX_FRAME_DELAY) are kept in memory.
+int traceAll()
 {
-	// redeclare currentFrameGroup
-	for (FRAME_GROUP currentFrameGroup=firstFrameGroup; currentFrameGroup<maxFrameGroups; currentFrameGroup++)
+	std::vector<SolutionNode> finishNodes;
+	FRAME_GROUP exitGroup;
+	for (exitGroup=MAX_FRAME_GROUPS-1; exitGroup>=0; exitGroup--)
+		if (fileExists(formatFileName("closed", exitGroup)) && findSolutionFinishNodes(exitGroup, finishNodes))
+			break;
+	if (exitGroup < 0)
 	{
-		if (!fileExists(formatFileName("open", currentFrameGroup)))
-			continue;
-
-		printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT "/" GROUP_FORMAT ": ", currentFrameGroup, maxFrameGroups); fflush(stdout);
+		printf("Exit not found.\n");
+		return EXIT_NOTFOUND;
+	}
+	std::sort(finishNodes.begin(), finishNodes.end());
+	printTime(); printf("%u finish states found at frame %u.\n", (unsigned)finishNodes.size(), finishNodes[0].frame);
 
-		uint64_t initialSize, finalSize;
+	// Nodes in the exit frame group have the same frame as the finish nodes, unless frames are grouped.
+	solutionWindow.clear();
+	solutionGroup.clear();
+	if (FRAMES_PER_GROUP > 1)
+		solutionGroup.swap(finishNodes);
+	else
+		solutionWindow.swap(finishNodes);
 
-		if (fileExists(formatFileName("merged", currentFrameGroup)))
+	if (fileExists(formatFileName("solutions")))
+		deleteFile(formatFileName("solutions"));
+	BufferedOutputStream<SolutionEdge> output(formatFileName("solutions"));
+	uint64_t states = solutionGroup.size() + solutionWindow.size(), steps = 0, solutions = 0;
+	for (FRAME_GROUP g = FRAMES_PER_GROUP > 1 ? exitGroup : exitGroup-1; g >= 0; g--)
+	{
+		// Parents in this or an earlier frame group lie before frame (g+1)*FRAMES_PER_GROUP, so they can't lead to nodes
+		// MAX_FRAME_DELAY frames or more after that.
+		if (ProblemTraits::maxFrameDelay)
 		{
-			printf("(reopening merged)    ");
+			std::vector<SolutionNode> kept;
+			for (size_t i=0; i<solutionWindow.size(); i++)
+				if (solutionWindow[i].frame < (g+1) * FRAMES_PER_GROUP + ProblemTraits::maxFrameDelay)
+					kept.push_back(solutionWindow[i]);
+			solutionWindow.swap(kept);
 		}
-		else
+		if (!fileExists(formatFileName("closed", g)))
+			continue;
+		printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT "... ", g); fflush(stdout);
+
+		// One pass finds the parents of all known nodes. With grouped frames, the new nodes can themselves have parents
+		// in the same frame group, which are found by repeating the pass with only the new nodes as targets.
+		std::vector<SolutionNode> targets = solutionGroup.empty() ? solutionWindow : solutionGroup;
+		solutionGroupEdges.clear();
+		size_t found = 0;
+		while (!targets.empty())
 		{
-			{
-				InputStream s(formatFileName("open", currentFrameGroup));
-				initialSize = s.size();
-			}
-
-			// Step 1 & 2: sort and merge open nodes
-			sortAndMerge(currentFrameGroup);
+			solutionTargetsBegin = targets.data();
+			solutionTargetsEnd   = targets.data() + targets.size();
+			found += findSolutionParents(g);
+			if (FRAMES_PER_GROUP == 1)
+				break;
+			targets = solutionNewNodes;
 		}
 
-		// Step 3: dedup against previous frames
-		printf("Filtering... "); fflush(stdout);
+		// Count the paths, handling each edge after all edges leaving its child.
+		std::stable_sort(solutionGroupEdges.begin(), solutionGroupEdges.end(), solutionEdgeLater);
+		for (size_t i=0; i<solutionGroupEdges.size(); i++)
 		{
-			class NullStateHandler
-			{
-			public:
-				INLINE static void handle(const CompressedState* state) {}
-			};
-
-			BufferedInputStream* source = new BufferedInputStream(formatFileName("merged", currentFrameGroup));
-			BufferedInputStream* inputs = new BufferedInputStream[MAX_FRAME_GROUPS+1];
-			int inputCount = 0;
-			for (FRAME_GROUP g=currentFrameGroup-1; g>=0; g--)
-			{
-#ifdef USE_ALL
-				if (fileExists(formatFileName("all", g)))
-				{
-					Node *allReadBuffer = (Node*)ram;
+			SolutionNode* parent = findSolutionNode(solutionGroupEdges[i].parent);
+			const SolutionNode* child = findSolutionNode(solutionGroupEdges[i].child);
+			parent->paths = parent->paths + child->paths < parent->paths ? UINT64_MAX : parent->paths + child->paths; // saturate
+		}
+		for (size_t i=0; i<solutionGroupEdges.size(); i++)
+			output.write(&solutionGroupEdges[i]);
+		steps += solutionGroupEdges.size();
+		states += found;
+		printf("%u nodes on optimal paths.\n", (unsigned)found);
+
+		for (size_t i=0; i<solutionGroup.size(); i++)
+			if (solutionGroup[i].frame == 0)
+				solutions = solutions + solutionGroup[i].paths < solutions ? UINT64_MAX : solutions + solutionGroup[i].paths;
+
+		size_t middle = solutionWindow.size();
+		solutionWindow.insert(solutionWindow.end(), solutionGroup.begin(), solutionGroup.end());
+		std::inplace_merge(solutionWindow.begin(), solutionWindow.begin() + middle, solutionWindow.end());
+		solutionGroup.clear();
+	}
+	output.close();
+
+	printTime(); printf("%llu optimal solutions (%llu states, %llu steps) written to %s.\n",
+		(unsigned long long)solutions, (unsigned long long)states, (unsigned long long)steps, formatFileName("solutions"));
+	return EXIT_OK;
+}
 
-					inputs[inputCount  ].setReadBuffer(allReadBuffer, ALL_FILE_BUFFER_SIZE);
-					inputs[inputCount++].open(formatFileName("all", g));
-					break;
-				}
 #endif
-				const char* fn = formatFileName("open", g);
-				if (!fileExists(fn))
-					fn = formatFileName("closed", g);
-				if (fileExists(fn))
-				{
-					inputs[inputCount].open(fn);
-					if (inputs[inputCount].size())
-						inputCount++;
-					else
-						inputs[inputCount].close();
-				}
-			}
-			
-			{
-				InputHeap<BufferedInputStream> input(inputs, inputCount);
-				BufferedOutputStream output(formatFileName("filtering", currentFrameGroup));
-				filterStream(source, &input, &output, &nullOutput);
-			}
-			delete source;
-			delete[] inputs;
-			deleteFile(formatFileName("merged", currentFrameGroup));
-		}
 
-		deleteFile(formatFileName("open", currentFrameGroup));
-		renameFile(formatFileName("filtering", currentFrameGroup), formatFileName("open", currentFrameGroup));
+// *************************************** Write-partial-solution ***************************************
 
-		{
-			InputStream s(formatFileName("open", currentFrameGroup));
-			finalSize = s.size();
-		}
+int writePartialSolution()
+{
+	if (!fileExists(formatFileName("solution")))
+		error(format("Partial trace solution file (%s) not found.", formatFileName("solution")));
+	
+	int stepNr;
+	Step steps[MAX_STEPS];
 
-		printf("Done: %lld -> %lld.\n", initialSize, finalSize);
+	loadExitTrace(steps, &stepNr);
+
+#ifdef USE_TRANSFORM_INVARIANT_SORTING
+	untransformSteps(&exitSearchState, exitSearchStateFrame, steps, stepNr);
+#endif
+	writeSolution(&exitSearchState, steps, stepNr);
 
-		if (checkStop())
-			return EXIT_STOP;
-	}
 	return EXIT_OK;
 }
 
-// ******************************************** Filter-open *********************************************
+// ********************************************** Autotune **********************************************
 
-void doFilterOpen(FRAME_GROUP firstFrameGroup, FRAME_GROUP maxFrameGroups)
-{
-	BufferedRewriteStream* open = new BufferedRewriteStream[MAX_FRAME_GROUPS];
-	for (FRAME_GROUP g=firstFrameGroup; g<maxFrameGroups; g++)
-		if (fileExists(formatFileName("open", g)))
-		{
-			enforce(!fileExists(formatFileName("closed", g)), format("Open and closed node files present for the same frame" GROUP_STR " " GROUP_FORMAT, g));
-			open[g].open(formatFileName("open", g));
-	    }
+/// The disk request sizes and expansion queue element sizes which autotune tries.
+const uint32_t autotuneRequestSizes[] = { 64<<10, 256<<10, 1<<20, 4<<20, 16<<20, 64<<20 };
+const unsigned autotuneElementSizes[] = { 0x100, 0x400, 0x1000, 0x4000, 0x10000 };
 
-	filterAgainstClosed<false>(open, MAX_FRAME_GROUPS);
+/// Returns the index of the smallest setting whose rate is within 10% of the best one.
+int autotuneKnee(const double rates[], int count)
+{
+	double best = 0;
+	for (int i=0; i<count; i++)
+		best = max(best, rates[i]);
+	for (int i=0; i<count; i++)
+		if (rates[i] >= best * 0.9)
+			return i;
+	return count-1;
+}
 
-	delete[] open;
+void autotuneSystem(unsigned* cores, uint64_t* physicalRam)
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	*cores = si.dwNumberOfProcessors;
+	MEMORYSTATUSEX ms;
+	ms.dwLength = sizeof(ms);
+	GlobalMemoryStatusEx(&ms);
+	*physicalRam = ms.ullTotalPhys;
+#else
+	*cores = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+	*physicalRam = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+#endif
 }
 
-int filterOpen()
+/// Measures the sequential write and read throughput (in MB/s) of a file of "total" bytes in the current directory,
+/// transferred in requests of "request" bytes. The file is read back past the OS cache, which would hold it right after writing.
+void autotuneDisk(uint32_t request, uint64_t total, double* writeRate, double* readRate)
 {
-	doFilterOpen(0, MAX_FRAME_GROUPS);
-	return EXIT_OK;
+	const char* filename = formatProblemFileName("autotune", NULL, "bin");
+	size_t nodes = request / sizeof(Node);
+	RamArenas arenas;
+	char* unaligned = arenas.allocate<char>("autotune disk", request + UNCACHED_IO_ALIGNMENT);
+	Node* buf = (Node*)(((uintptr_t)unaligned + UNCACHED_IO_ALIGNMENT-1) & ~(uintptr_t)(UNCACHED_IO_ALIGNMENT-1));
+	memset(buf, 0x5A, nodes * sizeof(Node));
+
+	uint64_t start = microseconds();
+	uint64_t written = 0;
+	{
+		OutputStream<Node> output(filename, false);
+		for (; written<total; written+=nodes*sizeof(Node))
+			output.write(buf, nodes);
+		output.flush();
+	}
+	*writeRate = written / (double)max<uint64_t>(microseconds() - start, 1);
+
+	start = microseconds();
+	uint64_t read = 0;
+	{
+		UncachedInputStream input(filename);
+		size_t r;
+		while (r = input.read(buf, request))
+			read += r;
+	}
+	*readRate = read / (double)max<uint64_t>(microseconds() - start, 1);
+
+	deleteFile(filename);
 }
 
-// ****************************************** Regenerate-open *******************************************
+/// Measures the time in nanoseconds per node which the Expanding step spends on a node in its sort and merge kernels,
+/// with the given queue element size: sorting every element, then merging all sorted elements.
+double autotuneSortMerge(unsigned element, const OpenNode* nodes, OpenNode* work, OpenNode* output, unsigned count)
+{
+	memcpy(work, nodes, count * sizeof(OpenNode));
+	uint64_t start = microseconds();
+	TimSort<OpenNode> sort;
+	for (unsigned pos=0; pos<count; pos+=element)
+		sort.sort(work + pos, (int)min(element, count-pos));
+	MemoryOutputStream<OpenNode> out(output, output + count);
+	mergeChunks<OpenNode>(work, count, element, &out);
+	return (microseconds() - start) * 1000. / count;
+}
 
-int regenerateOpen()
+/// Measures the memory bandwidth in MB/s (bytes read plus bytes written), by copying within "ram".
+double autotuneMemory()
 {
-	for (FRAME_GROUP g=0; g<MAX_FRAME_GROUPS; g++)
-		if (fileExists(formatFileName("closed", g)) || fileExists(formatFileName("open", g)))
-			noQueue[g] = true;
-	
-	while (maxFrameGroups>0 && !fileExists(formatFileName("closed", maxFrameGroups-1)))
-		maxFrameGroups--;
+	size_t half = (size_t)min<uint64_t>(ramSize / 2, 256<<20);
+	RamArenas arenas;
+	char* source = arenas.allocate<char>("autotune memory", half);
+	char* target = arenas.allocate<char>("autotune memory", half);
+	memset(source, 1, half); // fault the pages in
+	memset(target, 1, half);
+	uint64_t start = microseconds();
+	for (int i=0; i<4; i++)
+		memcpy(target, source, half);
+	return 4. * 2 * half / max<uint64_t>(microseconds() - start, 1);
+}
 
-	uint64_t oldSize = 0;
-	for (currentFrameGroup=firstFrameGroup; currentFrameGroup<maxFrameGroups; currentFrameGroup++)
-		if (fileExists(formatFileName("closed", currentFrameGroup)))
-		{
-			printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT "/" GROUP_FORMAT ": ", currentFrameGroup, maxFrameGroups); fflush(stdout);
-			
 #ifdef MULTITHREADING
-			startWorkers<&processState>();
-#endif
-			prepareOpen();
+# define AUTOTUNE_RING_SIZE 0x1000
 
-			BufferedInputStream closed(formatFileName("closed", currentFrameGroup));
-			const CompressedState* cs;
-			while (cs = closed.read())
-				processFilteredState(cs);
-			
-#ifdef MULTITHREADING
-			flushProcessingQueue();
-#endif
-			
-			printf("Flushing... "); fflush(stdout);
-			flushOpen();
-			
-			uint64_t size = 0;
-			for (FRAME_GROUP g=0; g<MAX_FRAME_GROUPS; g++)
-				if (queue[g])
-					size += queue[g]->size();
+/// Each worker expands a ring of recently generated states, starting over from the initial states when it runs dry.
+struct AutotuneWorker
+{
+	CompressedState ring[AUTOTUNE_RING_SIZE];
+	unsigned head, tail;
+	uint64_t children;
+} autotuneWorkers[MAX_WORKERS];
 
-			printf("Done (%lld).\n", size - oldSize);
-			oldSize = size;
+uint64_t autotuneDeadline;
 
-			if (checkStop())
-				return EXIT_STOP;
-		}
-	
-	return EXIT_OK;
-}
+class AutotuneChildHandler
+{
+public:
+	enum { PREFERRED = PREFERRED_STATE_COMPRESSED };
+
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const CompressedState* cs, FRAME frame)
+	{
+		AutotuneWorker* w = &autotuneWorkers[TLS_GET_THREAD_ID];
+		w->children++;
+		w->ring[w->head++ % AUTOTUNE_RING_SIZE] = *cs;
+		if (w->head - w->tail > AUTOTUNE_RING_SIZE)
+			w->tail = w->head - AUTOTUNE_RING_SIZE;
+	}
 
-// ********************************************* Create-all *********************************************
+	static INLINE void handleChild(const State* parent, FRAME parentFrame, Step step, const State* state, FRAME frame)
+	{
+		CompressedState cs;
+		state->compress(&cs);
+		handleChild(parent, parentFrame, step, &cs, frame);
+	}
+};
 
-int createAll()
+void autotuneExpansionWorker()
 {
-	FRAME_GROUP maxClosed = -1;
-	BufferedInputStream<Node>* closed = new BufferedInputStream<Node>[MAX_FRAME_GROUPS];
-	for (FRAME_GROUP g=0; g<MAX_FRAME_GROUPS; g++)
-		if (fileExists(formatFileName("closed", g)))
-		{
-			closed[g].open(formatFileName("closed", g));
-			if (maxClosed == -1)
-				maxClosed = g;
-		}
-	enforce(maxClosed >= 0, "No closed node files found");
+	AutotuneWorker* w = &autotuneWorkers[TLS_GET_THREAD_ID];
+	w->head = w->tail = 0;
+	w->children = 0;
+	for (unsigned n=0; (n & 0xFF) || microseconds() < autotuneDeadline; n++)
+	{
+		if (w->tail == w->head)
+			for (int i=0; i<initialStateCount; i++)
+				AutotuneChildHandler::handleChild(NULL, 0, Step(), &initialStates[i], 0);
+		State state;
+		state.decompress(&w->ring[w->tail++ % AUTOTUNE_RING_SIZE]);
+		expandChildren<AutotuneChildHandler>(0, &state);
+	}
+
+	SCOPED_LOCK lock(processQueueMutex);
+	runningWorkers--;
+	CONDITION_NOTIFY(processQueueExitCondition, lock);
+}
 
+/// Measures how many children per second the given number of workers generate together.
+double autotuneExpansion(unsigned workers)
+{
+	uint64_t start = microseconds();
+	autotuneDeadline = start + 1000000;
 	{
-		BufferedOutputStream<BareNode> all(formatFileName("allnew", maxClosed));
-		mergeStreams(closed, MAX_FRAME_GROUPS, &all);
+		SCOPED_LOCK lock(processQueueMutex);
+		runningWorkers += workers;
 	}
-	delete[] closed;
+	for (THREAD_ID threadID=0; threadID<workers; threadID++)
+		THREAD_CREATE<autotuneExpansionWorker>(threadID);
+	flushProcessingQueue();
+	uint64_t elapsed = microseconds() - start;
 
-	renameFile(formatFileName("allnew", maxClosed), formatFileName("all", maxClosed));
-	return EXIT_OK;
+	uint64_t children = 0;
+	for (unsigned i=0; i<workers; i++)
+		children += autotuneWorkers[i].children;
+	return children * 1e6 / elapsed;
 }
 #endif
 
-// ********************************************* Find-exit **********************************************
-
-int findExit()
+/// Runs short calibration benchmarks of this machine, and writes the recommended settings to the options file.
+int autotune(uint64_t probeSize)
 {
-	if (fileExists(formatFileName("solution")))
-		error(format("Partial trace solution file (%s) present - if you want to resume exit tracing, run \"search\" instead, otherwise delete the file", formatFileName("solution")));
-	
-	// redeclare currentFrameGroup
-	for (FRAME_GROUP currentFrameGroup=firstFrameGroup; currentFrameGroup<maxFrameGroups; currentFrameGroup++)
+	const char* optionsFileName = formatProblemFileName("options", NULL, "txt");
+	enforce(!fileExists(optionsFileName), format("%s already exists, and would skew the measurements; delete it first", optionsFileName));
+
+	unsigned cores;
+	uint64_t physicalRam;
+	autotuneSystem(&cores, &physicalRam);
+	printf("%u cores, %llu MB of physical RAM\n", cores, (unsigned long long)(physicalRam >> 20));
+
+	// Disk
+	const int requestSizes = sizeof(autotuneRequestSizes) / sizeof(autotuneRequestSizes[0]);
+	double writeRates[requestSizes], readRates[requestSizes], slowerRates[requestSizes];
+#ifdef DISK_WINFILES
+	diskIOChunkSize = autotuneRequestSizes[requestSizes-1]; // don't split the probed requests
+#endif
+	for (int i=0; i<requestSizes; i++)
 	{
-		const char* fn = formatFileName("closed", currentFrameGroup);
-		if (!fileExists(fn))
-			fn = formatFileName("open", currentFrameGroup);
-		if (fileExists(fn))
+		if (autotuneRequestSizes[i] + UNCACHED_IO_ALIGNMENT > ramSize)
 		{
-			printTime(); printf("Frame" GROUP_STR " " GROUP_FORMAT "/" GROUP_FORMAT ": ", currentFrameGroup, maxFrameGroups); fflush(stdout);
-			BufferedInputStream<Node> input(fn);
-			const Node* cs;
-			while (cs = input.read())
-			{
-				State s;
-				s.decompress(&cs->getState());
-				if (s.isFinish())
-				{
-					FRAME exitFrame = GET_FRAME(currentFrameGroup, *cs);
-					printTime();
-					printf("Exit found (at frame %u), tracing path...\n", exitFrame);
-					traceExit(&s, exitFrame);
-					return EXIT_OK;
-				}
-			}
-			printf("Done.\n");
+			writeRates[i] = readRates[i] = slowerRates[i] = 0;
+			continue;
 		}
-	}
-	printf("Exit not found.\n");
-	return EXIT_NOTFOUND;
-}
+		autotuneDisk(autotuneRequestSizes[i], max<uint64_t>(probeSize, autotuneRequestSizes[i]), &writeRates[i], &readRates[i]);
+		slowerRates[i] = min(writeRates[i], readRates[i]);
+		printf("Disk, %5u KB requests: %8.1f MB/s write, %8.1f MB/s read\n", autotuneRequestSizes[i] >> 10, writeRates[i], readRates[i]);
+	}
+	uint32_t standardRequest = autotuneRequestSizes[autotuneKnee(slowerRates, requestSizes)];
+	uint32_t closedInRequest = autotuneRequestSizes[autotuneKnee(readRates , requestSizes)];
+#ifdef DISK_WINFILES
+	uint32_t diskChunk       = autotuneRequestSizes[autotuneKnee(writeRates, requestSizes)];
+#endif
 
+	// Memory
+	printf("Memory: %.1f MB/s\n", autotuneMemory());
+	uint64_t recommendedRam = (physicalRam / 4 * 3) >> 20 << 20;
+	recommendedRam = min<uint64_t>(recommendedRam, ((uint64_t)(BUFFER_INDEX)-1 * sizeof(Node)) >> 20 << 20); // see LARGE_BUFFERS
 
-// *************************************** Write-partial-solution ***************************************
+	// Expansion
+	unsigned workers = 1;
+#ifdef MULTITHREADING
+	// Powers of two, and one worker per core with and without one left for the main thread
+	unsigned maxWorkers = min<unsigned>(cores, MAX_WORKERS);
+	unsigned candidates[MAX_WORKERS], candidateCount = 0;
+	for (unsigned w=1; w+1<maxWorkers; w*=2)
+		candidates[candidateCount++] = w;
+	if (maxWorkers > 1)
+		candidates[candidateCount++] = maxWorkers-1;
+	candidates[candidateCount++] = maxWorkers;
+
+	double bestRate = 0;
+	for (unsigned i=0; i<candidateCount; i++)
+	{
+		unsigned w = candidates[i];
+		double rate = autotuneExpansion(w);
+		printf("Expansion, %2u workers: %12.0f children/s (%.0f per worker)\n", w, rate, rate / w);
+		if (rate > bestRate * 1.02)
+		{
+			bestRate = rate;
+			workers = w;
+		}
+	}
+#endif
 
-int writePartialSolution()
-{
-	if (!fileExists(formatFileName("solution")))
-		error(format("Partial trace solution file (%s) not found.", formatFileName("solution")));
-	
-	int stepNr;
-	Step steps[MAX_STEPS];
+	// Sort and merge kernels, on random nodes
+	unsigned count = (unsigned)min<uint64_t>(OPENNODE_BUFFER_SIZE / 3, 4<<20);
+	RamArenas arenas;
+	OpenNode* nodes  = arenas.allocate<OpenNode>("autotune sort", count);
+	OpenNode* work   = arenas.allocate<OpenNode>("autotune sort", count);
+	OpenNode* output = arenas.allocate<OpenNode>("autotune sort", count);
+	srand(1);
+	for (size_t i=0; i<count * sizeof(OpenNode); i++)
+		((uint8_t*)nodes)[i] = (uint8_t)rand();
+	const int elementSizes = sizeof(autotuneElementSizes) / sizeof(autotuneElementSizes[0]);
+	unsigned element = autotuneElementSizes[0];
+	double bestTime = 0;
+	for (int i=0; i<elementSizes; i++)
+	{
+		// The expansion buffer must keep a few free elements per worker
+		if ((uint64_t)autotuneElementSizes[i] * 4 * workers > recommendedRam / sizeof(OpenNode) || autotuneElementSizes[i] > count)
+			break;
+		double time = autotuneSortMerge(autotuneElementSizes[i], nodes, work, output, count);
+		printf("Sort+merge, %6u-node elements: %6.1f ns/node\n", autotuneElementSizes[i], time);
+		if (i==0 || time < bestTime)
+		{
+			bestTime = time;
+			element = autotuneElementSizes[i];
+		}
+	}
 
-	FILE* f = fopen(formatFileName("solution"), "rb");
-	fread(&exitSearchFrameGroup, sizeof(exitSearchFrameGroup), 1, f);
-	fread(&exitSearchStateFrame, sizeof(exitSearchStateFrame), 1, f);
-	fread(&exitSearchState     , sizeof(exitSearchState)     , 1, f);
-	fread(&stepNr              , sizeof(stepNr)              , 1, f);
-	fread(steps, sizeof(Step), stepNr, f);
-	fclose(f);
+	char options[1024];
+	int length = 0;
+	length += sprintf(options + length, "--ram-size %lluM\n", (unsigned long long)(recommendedRam >> 20));
+#ifdef MULTITHREADING
+	length += sprintf(options + length, "--threads %u\n", workers + 1);
+#endif
+	length += sprintf(options + length, "--standard-buffer-size %uK\n", standardRequest >> 10);
+	length += sprintf(options + length, "--closed-in-buffer-size %uK\n", closedInRequest >> 10);
+	length += sprintf(options + length, "--expansion-nodes-per-queue-element %u\n", element);
+#ifdef DISK_WINFILES
+	length += sprintf(options + length, "--disk-io-chunk-size %uK\n", diskChunk >> 10);
+#endif
 
-	writeSolution(&exitSearchState, steps, stepNr);
+	// Apply the settings the way loadOptionsFile will, so that a search won't refuse the file
+	char name[256], value[256];
+	for (int pos=0, n; sscanf(options + pos, "%255s %255s%n", name, value, &n) == 2; pos += n)
+		enforce(setOption(name, value), format("Invalid option: %s", name));
+	checkOptions();
 
+	FILE* f = fopen(optionsFileName, "wt");
+	enforce(f, format("Can't create %s", optionsFileName));
+	fprintf(f, "# Written by autotune\n%s", options);
+	fclose(f);
+	printf("Recommended settings written to %s\n", optionsFileName);
 	return EXIT_OK;
 }
 
@@ -4609,11 +6921,20 @@ void printExecutionTime()
 	ftime(&endTime);
 	time_t ms = (endTime.time - startTime.time)*1000
 	       + (endTime.millitm - startTime.millitm);
+	printRamArenas();
 	printf("Time: %d.%03d seconds.\n", ms/1000, ms%1000);
 }
 
 // ***********************************************************************************
 
+void checkCompressedStateOrder(const CompressedState& a, const CompressedState& b, int expected)
+{
+	bool ok = (a == b) == (expected == 0) && (a != b) == (expected != 0)
+	       && (a <  b) == (expected <  0) && (a <= b) == (expected <= 0)
+	       && (a >  b) == (expected >  0) && (a >= b) == (expected >= 0);
+	enforce(ok, format("Wrong comparison result (expected %d)!\n%s\n%s", expected, hexDump(&a, COMPRESSED_BYTES), hexDump(&b, COMPRESSED_BYTES)));
+}
+
 // Test the CompressedState comparison operators.
 void testCompressedState()
 {
@@ -4660,6 +6981,30 @@ void testCompressedState()
 		p2[i/8] |= (1<<(i%8));
 		enforce(c1 == c2, format(  "Equality expected!\n%s\n%s", hexDump(p1, sizeof(Node)), hexDump(p2, sizeof(Node))));
 	}
+
+#ifndef USE_MEMCMP
+	// Check the ordering against the state compared as one little-endian integer (which the comparison operators must agree
+	// with, so that existing node files stay sorted): every pair of values in every byte, and every pair of opposing bytes.
+	for (int i=0; i<COMPRESSED_BYTES; i++)
+	{
+		memset(p1, 0x5A, COMPRESSED_BYTES);
+		memset(p2, 0x5A, COMPRESSED_BYTES);
+		for (int v1=0; v1<0x100; v1++)
+			for (int v2=0; v2<0x100; v2++)
+			{
+				p1[i] = (uint8_t)v1;
+				p2[i] = (uint8_t)v2;
+				checkCompressedStateOrder(c1.getState(), c2.getState(), v1 < v2 ? -1 : v1 > v2 ? 1 : 0);
+			}
+		for (int j=0; j<i; j++)
+		{
+			memset(p1, 0, COMPRESSED_BYTES);
+			memset(p2, 0, COMPRESSED_BYTES);
+			p1[i] = 1; p2[j] = 0xFF;
+			checkCompressedStateOrder(c1.getState(), c2.getState(), 1);
+		}
+	}
+#endif
 }
 
 // ***********************************************************************************
@@ -4693,23 +7038,26 @@ const char* usage = "\
 Generic C++ DDD solver\n\
 (c) 2009-2010 Vladimir \"CyberShadow\" Panteleev\n\
 Usage:\n\
-	search <mode> <parameters>\n\
+	search [<options>] <mode> <parameters>\n\
 where <mode> is one of:\n\
 	search [max-frame"GROUP_STR"]\n\
 		Sorts, filters and expands open nodes. 	If no open node files\n\
 		are present, starts a new search from the initial state.\n"
-#if 0
-"	grouped-search <size>\n\
+#ifndef BIDIRECTIONAL_SEARCH
+"	grouped-search <size> [max-frame"GROUP_STR"]\n\
 		Performs the same operation as \"search\", but processes <size>\n\
-		open frame"GROUP_STR"s at once. The nodes for each frame"GROUP_STR"\n\
-		are expanded without being filtered, and all frame"GROUP_STR"s are\n\
-		sorted, filtered and \"closed\" at the end. This mode is useful\n\
-		when the open node files become much smaller than the total\n\
-		size of the closed node files.\n\
-	grouped-search-no-filter <size>\n\
-		Same as above, but does not sort and filter the node files\n\
-		before expanding them. Use with care, as it may lead to an\n\
-		explosion in the number of open nodes.\n"
+		frame"GROUP_STR"s at once. The nodes for each frame"GROUP_STR" are\n\
+		only filtered against the nodes found within the batch, and the\n\
+		combined node file is filtered and rewritten once at the end of\n\
+		the batch. This mode is useful when the open nodes become much\n\
+		fewer than the nodes in the combined node file.\n"
+#endif
+#ifdef HAVE_PATTERN_DATABASE
+"	build-pdb\n\
+		Builds the pattern database by searching backwards from the\n\
+		finish states in the problem's abstract state space. When\n\
+		present, the pattern database is used by \"search\" to discard\n\
+		states which can't reach the finish in time.\n"
 #endif
 "	dump <frame"GROUP_STR">\n\
 		Dumps all states from the specified frame"GROUP_STR", which\n\
@@ -4734,52 +7082,58 @@ where <mode> is one of:\n\
 "	verify <filename>\n\
 		Verifies that the nodes in a file are correctly sorted and\n\
 		deduplicated, as well as a few additional integrity checks.\n"
-#if 0
-"	pack-open [frame"GROUP_STR"-range]\n\
-		Removes duplicates within each chunk for open node files in the\n\
-		specified range. Reads and writes open nodes only once.\n\
-	sort-open [frame"GROUP_STR"-range]\n\
-		Sorts and removes duplicates for open node files in the\n\
-		specified range. File are processed in reverse order.\n\
-	filter-open\n\
-		Filters all open node files. Requires that all open node files\n\
-		be sorted and deduplicated (run sort-open before filter-open).\n\
-		Filtering is performed in-place. An aborted run shouldn't cause\n\
-		data loss, but will require re-sorting.\n\
-	seq-filter-open [frame"GROUP_STR"-range]\n\
-		Sorts, deduplicates and filters open node files in the\n\
-		specified range, one by one. Specify the range cautiously,\n\
-		as this function requires that previous open node files be\n\
-		sorted and deduplicated (and filtered for best performance).\n\
-	regenerate-open [frame"GROUP_STR"-range]\n\
-		Re-expands closed nodes in the specified frame"GROUP_STR" range.\n\
-		New (open) nodes are saved only for frame"GROUP_STR"s that don't\n\
-		already have an open or closed node file. Use this when an open\n\
-		node file has been accidentally deleted or corrupted. To\n\
-		regenerate all open nodes, delete all open node files before\n\
-		running regenerate-open (this is still faster than restarting\n\
-		the search).\n\
-	create-all\n\
-		Creates the \"all\" file from closed node files. Use when\n\
-		turning on USE_ALL, or when the \"all\" file was corrupted.\n"
-#endif
 "	find-exit [frame"GROUP_STR"-range]\n\
 		Searches for exit frames in the specified frame"GROUP_STR" range\n\
 		(both closed an open node files). When a state is found which\n\
 		satisfies the isFinish condition, it is traced back and the\n\
 		solution is written, as during normal search.\n\
-	write-partial-solution\n\
+"
+#if !defined(BIDIRECTIONAL_SEARCH) && !defined(USE_TRANSFORM_INVARIANT_SORTING)
+"	trace-all\n\
+		Finds all optimal solutions of a finished search, in one pass\n\
+		over each closed node file. The steps between the states that\n\
+		lie on an optimal path are written to the solution DAG file\n\
+		(solutions.bin), and the number of optimal solutions is printed.\n"
+#endif
+"	write-partial-solution\n\
 		Saves the partial solution, using the partial exit trace\n\
 		solution file. Allows exit tracing inspection. Warning: uses\n\
 		the same code as when writing the full solution, and may\n\
 		overwrite an existing solution.\n\
+	autotune [probe-size]\n\
+		Runs short calibration benchmarks in the current directory:\n\
+		sequential disk throughput at several request sizes (writing\n\
+		and reading probe-size bytes for each, 256M by default, with\n\
+		the reads bypassing the OS file cache), memory bandwidth, the\n\
+		expansion rate for different numbers of workers, and the sort\n\
+		and merge kernels for different queue element sizes. Writes\n\
+		the recommended settings to the options file.\n\
 A [frame"GROUP_STR"-range] is a space-delimited list of zero, one or two frame"GROUP_STR"\n\
 numbers. If zero numbers are specified, the range is assumed to be all\n\
 frame"GROUP_STR"s. If one number is specified, the range is set to only that\n\
 frame"GROUP_STR" number. If two numbers are specified, the range is set to start\n\
 from the first frame"GROUP_STR" number inclusively, and end at the second\n\
 frame"GROUP_STR" number NON-inclusively.\n\
-";
+<options> override the config.h settings of the same names, and are\n\
+\"--name value\" pairs. Sizes are in bytes, with an optional K, M or\n\
+G suffix. The same pairs can be put in the options file (options.txt),\n\
+which is read after the command line, and reread at the start of every\n\
+frame"GROUP_STR" by the search modes.\n\
+	--ram-size <size>\n\
+	--standard-buffer-size <size>\n\
+	--closed-in-buffer-size <size>\n\
+	--expansion-nodes-per-queue-element <count>\n"
+#ifdef HAVE_DOMINANCE
+"	--dominance-max-run <count>\n"
+#endif
+#ifdef MULTITHREADING
+"	--threads <count>\n\
+	--queue-chunk-size <count> (at most the config.h setting)\n"
+#endif
+#ifdef DISK_WINFILES
+"	--disk-io-chunk-size <size>\n"
+#endif
+;
 
 int run(int argc, const char* argv[])
 {
@@ -4789,6 +7143,16 @@ int run(int argc, const char* argv[])
 
 	initProblem();
 
+	// Options precede the command
+	int optionArgs = 0;
+	while (optionArgs+2 < argc && strncmp(argv[optionArgs+1], "--", 2)==0)
+	{
+		if (!setOption(argv[optionArgs+1], argv[optionArgs+2]))
+			error(format("Unknown option: %s", argv[optionArgs+1]));
+		optionArgs += 2;
+	}
+	loadOptionsFile();
+
 #ifdef DEBUG
 	printf("Debug version\n");
 #else
@@ -4796,17 +7160,25 @@ int run(int argc, const char* argv[])
 #endif
 
 #ifdef MULTITHREADING
-	printf("Using %u "PLUGIN_THREAD" threads (with %u node chunks) with "PLUGIN_SYNC" sync and "PLUGIN_TLS" TLS\n", THREADS, QUEUE_CHUNK_SIZE);
+	printf("Using %u "PLUGIN_THREAD" threads (with %u node chunks) with "PLUGIN_SYNC" sync and "PLUGIN_TLS" TLS\n", threads, queueChunkSize);
 #endif
 	
 	printf("Compressed state is %u bits (%u bytes data, %u bytes per closed node, %u bytes per open node)\n", COMPRESSED_BITS, COMPRESSED_BYTES, sizeof(Node), sizeof(OpenNode));
 #ifdef SLOW_COMPARE
 	printf("Using memcmp for CompressedState comparison\n");
+#endif
+#ifdef SIMD_COMPARE
+	printf("Using "
+# ifdef __AVX2__
+		"AVX2"
+# else
+		"SSE2"
+# endif
+		" for CompressedState comparison\n");
 #endif
 	testCompressedState();
 
-	enforce(ram, "RAM allocation failed");
-	printf("Using %lld bytes of RAM for %lld buffer nodes\n", (long long)RAM_SIZE, (long long)OPENNODE_BUFFER_SIZE);
+	printf("Using %lld bytes of RAM for %lld buffer nodes\n", (long long)ramSize, (long long)OPENNODE_BUFFER_SIZE);
 
 #if defined(DISK_WINFILES)
 	printf("Using Windows API files");
@@ -4835,6 +7207,8 @@ int run(int argc, const char* argv[])
 	for (int i=0; i<argc; i++)
 		printf(" %s", argv[i]);
 	printf("\n");
+	argc -= optionArgs; // argv[0] is not used below
+	argv += optionArgs;
 
 	maxFrameGroups = MAX_FRAME_GROUPS+1;
 
@@ -4845,20 +7219,29 @@ int run(int argc, const char* argv[])
 	{
 		if (argc>2)
 			maxFrameGroups = parseInt(argv[2]);
+#ifdef HAVE_PATTERN_DATABASE
+		loadPatternDatabase();
+#endif
 		return search();
 	}
-#if 0
+#ifdef HAVE_PATTERN_DATABASE
 	else
-	if (argc>1 && strcmp(argv[1], "grouped-search")==0)
+	if (argc>1 && strcmp(argv[1], "build-pdb")==0)
 	{
-		enforce(argc==3, "Specify how many frame"GROUP_STR"s to process at once");
-		return groupedSearch(parseInt(argv[2]), true);
+		return buildPatternDatabase();
 	}
+#endif
+#ifndef BIDIRECTIONAL_SEARCH
 	else
-	if (argc>1 && strcmp(argv[1], "grouped-search-no-filter")==0)
+	if (argc>1 && strcmp(argv[1], "grouped-search")==0)
 	{
-		enforce(argc==3, "Specify how many frame"GROUP_STR"s to process at once");
-		return groupedSearch(parseInt(argv[2]), false);
+		enforce(argc>=3, "Specify how many frame"GROUP_STR"s to process at once");
+		if (argc>3)
+			maxFrameGroups = parseInt(argv[3]);
+#ifdef HAVE_PATTERN_DATABASE
+		loadPatternDatabase();
+#endif
+		return groupedSearch(parseInt(argv[2]));
 	}
 #endif
 	else
@@ -4905,52 +7288,28 @@ int run(int argc, const char* argv[])
 		enforce(argc==3, "Specify a file to verify");
 		return verify(argv[2]);
 	}
-#if 0
-	else
-	if (argc>1 && strcmp(argv[1], "pack-open")==0)
-	{
-		parseFrameRange(argc-2, argv+2);
-		return packOpen();
-	}
-	else
-	if (argc>1 && strcmp(argv[1], "sort-open")==0)
-	{
-		parseFrameRange(argc-2, argv+2);
-		return sortOpen();
-	}
 	else
-	if (argc>1 && strcmp(argv[1], "filter-open")==0)
-	{
-		return filterOpen();
-	}
-	else
-	if (argc>1 && strcmp(argv[1], "seq-filter-open")==0)
+	if (argc>1 && strcmp(argv[1], "find-exit")==0)
 	{
 		parseFrameRange(argc-2, argv+2);
-		return seqFilterOpen();
+		return findExit();
 	}
 	else
-	if (argc>1 && strcmp(argv[1], "regenerate-open")==0)
+#if !defined(BIDIRECTIONAL_SEARCH) && !defined(USE_TRANSFORM_INVARIANT_SORTING)
+	if (argc>1 && strcmp(argv[1], "trace-all")==0)
 	{
-		parseFrameRange(argc-2, argv+2);
-		return regenerateOpen();
+		return traceAll();
 	}
 	else
-	if (argc>1 && strcmp(argv[1], "create-all")==0)
-	{
-		return createAll();
-	}
 #endif
-	else
-	if (argc>1 && strcmp(argv[1], "find-exit")==0)
+	if (argc>1 && strcmp(argv[1], "write-partial-solution")==0)
 	{
-		parseFrameRange(argc-2, argv+2);
-		return findExit();
+		return writePartialSolution();
 	}
 	else
-	if (argc>1 && strcmp(argv[1], "write-partial-solution")==0)
+	if (argc>1 && strcmp(argv[1], "autotune")==0)
 	{
-		return writePartialSolution();
+		return autotune(argc>2 ? parseSize(argv[2]) : 256<<20);
 	}
 	else
 	{